@@ -0,0 +1,401 @@
+/*
+// ---------------------------------------------------------------
+// File: spiCapture.c
+//
+// Module: SPI bus analyzer capture.
+//
+// Description: Records what goes over the wire: SPMODE, chip
+//		select, the first bytes sent and received, and the
+//		start and completion timestamps of every transfer.
+//
+// Operation: spiCaptureStart() allocates a ring of records and
+//		installs spiCaptureBegin()/spiCaptureEnd() as the spiLib
+//		start and completion hooks.  At interrupt level each
+//		transfer costs one record fill of at most 2 * truncate
+//		payload bytes; when the ring is full the oldest records
+//		are overwritten.  After spiCaptureStop(), spiCaptureSave()
+//		writes the ring in the binary format described in
+//		spiCapture.h for decoding on a host.
+//
+//		Timestamps come from the BSP timestamp timer, a counter
+//		running at sysTimestampFreq() that wraps around.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "ioLib.h"
+#include "intLib.h"
+#include "semLib.h"
+#include "logLib.h"
+#include "sysLib.h"
+#include "spiLib.h"
+#include "spiCapture.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define CAP_HDR_SIZE	20
+#define CAP_REC_SIZE	20
+
+#define CAP_PUT16(p, v)	{ \
+	(p)[0] = (UINT8) ((v) >> 8); \
+	(p)[1] = (UINT8) (v); \
+}
+
+#define CAP_PUT32(p, v)	{ \
+	(p)[0] = (UINT8) ((v) >> 24); \
+	(p)[1] = (UINT8) ((v) >> 16); \
+	(p)[2] = (UINT8) ((v) >> 8); \
+	(p)[3] = (UINT8) (v); \
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL SPI_CAPTURE_REC *spiCapRing = 0L;	/* record ring */
+LOCAL int spiCapSize = 0;				/* records in ring */
+LOCAL int spiCapTruncate = 0;			/* payload bytes kept */
+LOCAL UINT32 spiCapHead = 0;			/* records completed */
+LOCAL SPI_CAPTURE_REC *spiCapCur = 0L;	/* transfer in progress */
+LOCAL BOOL spiCapRunning = FALSE;
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCaptureStart
+//
+// Purpose: start capturing bus transfers.
+//
+// Description: Keeps the last records transfers, each with at
+//		most truncate bytes of payload per direction (up to
+//		SPI_CAPTURE_MAX_BYTES).  A previous capture is
+//		discarded.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if capture is running, records is not
+//		positive or the ring cannot be allocated.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiCaptureStart(int records, int truncate)
+{
+	int iv;
+
+	if (spiCapRunning || (records < 1))
+		return ERROR;
+
+	if (truncate < 0)
+		truncate = 0;
+	if (truncate > SPI_CAPTURE_MAX_BYTES)
+		truncate = SPI_CAPTURE_MAX_BYTES;
+
+	/*
+	// -----------------------------------------------------------
+	// (re)allocate the ring.
+	// -----------------------------------------------------------
+	*/
+
+	if (spiCapRing && (spiCapSize != records)) {
+		free((char *) spiCapRing);
+		spiCapRing = 0L;
+	}
+
+	if (spiCapRing == 0L) {
+		spiCapRing = (SPI_CAPTURE_REC *)
+			malloc(records * sizeof (SPI_CAPTURE_REC));
+		if (spiCapRing == 0L) {
+			spiCapSize = 0;
+			return ERROR;
+		}
+	}
+
+	spiCapSize = records;
+	spiCapTruncate = truncate;
+	spiCapHead = 0;
+	spiCapCur = 0L;
+
+	sysTimestampEnable();
+
+	/*
+	// -----------------------------------------------------------
+	// install the hooks.
+	// -----------------------------------------------------------
+	*/
+
+	SPI_LOCK(iv);
+
+	spiStartHook = (FUNCPTR) spiCaptureBegin;
+	spiDoneHook = (FUNCPTR) spiCaptureEnd;
+	spiCapRunning = TRUE;
+
+	SPI_UNLOCK(iv);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCaptureStop
+//
+// Purpose: stop capturing bus transfers.
+//
+// Description: The records stay available for spiCaptureSave().
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if capture is not running.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiCaptureStop(void)
+{
+	int iv;
+
+	if (!spiCapRunning)
+		return ERROR;
+
+	SPI_LOCK(iv);
+
+	spiStartHook = 0;
+	spiDoneHook = 0;
+	spiCapRunning = FALSE;
+	spiCapCur = 0L;
+
+	SPI_UNLOCK(iv);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCaptureBegin
+//
+// Purpose: record the start of a transfer.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: spiLib start hook, called just before the
+//		transfer is started; by the spidev backend after the
+//		message, so the record is marked SPI_CAPTURE_UNTIMED.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiCaptureBegin(SPI_CB *cb, SPI_CMD *cmd)
+{
+	SPI_CAPTURE_REC *rec = spiCapRing + (spiCapHead % spiCapSize);
+	int n;
+
+	rec->Start = sysTimestamp();
+	rec->End = rec->Start;
+	rec->Mode = (UINT16) cmd->Mode;
+	rec->Cs = (UINT16) cmd->Cs;
+	rec->TxSize = (UINT16) cmd->TxSize;
+	rec->RxSize = 0;
+	rec->Id = (UINT8) cb->Id;
+#ifdef SPI_SPIDEV
+	rec->Flags = SPI_CAPTURE_UNTIMED;
+#else
+	rec->Flags = 0;
+#endif
+	rec->RxLen = 0;
+
+	n = (cmd->TxSize < spiCapTruncate) ? cmd->TxSize : spiCapTruncate;
+	if ((n < 0) || (cmd->TxBuf == 0L))
+		n = 0;
+
+	rec->TxLen = (UINT8) n;
+	memcpy(rec->Tx, cmd->TxBuf, n);
+
+	spiCapCur = rec;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCaptureEnd
+//
+// Purpose: record the completion of a transfer.
+//
+// Description: Commits the record started by spiCaptureBegin().
+//		A transfer that was cancelled never completes; its
+//		record is reused by the next transfer.
+//
+// Architecture:
+//
+// Relationship: spiLib completion hook, called when the receive
+//		buffer is closed and before the PostOp.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiCaptureEnd(SPI_CB *cb, SPI_CMD *cmd)
+{
+	SPI_CAPTURE_REC *rec = spiCapCur;
+	int n;
+
+	if (rec == 0L)
+		return;
+
+	rec->End = sysTimestamp();
+	rec->RxSize = (UINT16) cmd->RxSize;
+
+	n = (cmd->RxSize < spiCapTruncate) ? cmd->RxSize : spiCapTruncate;
+	if ((n < 0) || (cmd->RxBuf == 0L))
+		n = 0;
+
+	rec->RxLen = (UINT8) n;
+	memcpy(rec->Rx, cmd->RxBuf, n);
+
+	spiCapCur = 0L;
+	spiCapHead++;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCaptureSave
+//
+// Purpose: write the captured transfers to a file.
+//
+// Description: See spiCapture.h for the file format.
+//
+// Architecture:
+//
+// Relationship: spiCaptureStop() must have been called.
+//
+// Returns: OK, or ERROR if capture is running, nothing was
+//		captured or the file cannot be written.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiCaptureSave(char *fileName)
+{
+	int fd;
+	int n;
+	UINT32 i;
+	UINT32 count;
+	SPI_CAPTURE_REC *rec;
+	UINT8 buf[CAP_REC_SIZE + 2 * SPI_CAPTURE_MAX_BYTES];
+
+	if (spiCapRunning || (spiCapRing == 0L) || (spiCapHead == 0))
+		return ERROR;
+
+	count = (spiCapHead < (UINT32) spiCapSize) ?
+		spiCapHead : (UINT32) spiCapSize;
+
+	if ((fd = open(fileName, O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0)
+		return ERROR;
+
+	/*
+	// -----------------------------------------------------------
+	// file header.
+	// -----------------------------------------------------------
+	*/
+
+	CAP_PUT32(buf, SPI_CAPTURE_MAGIC);
+	CAP_PUT16(buf + 4, SPI_CAPTURE_VERSION);
+	CAP_PUT16(buf + 6, spiCapTruncate);
+	CAP_PUT32(buf + 8, sysTimestampFreq());
+	CAP_PUT32(buf + 12, count);
+	CAP_PUT32(buf + 16, spiCapHead - count);
+
+	if (write(fd, (char *) buf, CAP_HDR_SIZE) != CAP_HDR_SIZE) {
+		close(fd);
+		return ERROR;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// records, oldest first.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = spiCapHead - count; i != spiCapHead; ++i) {
+
+		rec = spiCapRing + (i % spiCapSize);
+
+		CAP_PUT32(buf, rec->Start);
+		CAP_PUT32(buf + 4, rec->End);
+		CAP_PUT16(buf + 8, rec->Mode);
+		CAP_PUT16(buf + 10, rec->Cs);
+		CAP_PUT16(buf + 12, rec->TxSize);
+		CAP_PUT16(buf + 14, rec->RxSize);
+		buf[16] = rec->Id;
+		buf[17] = rec->Flags;
+		buf[18] = rec->TxLen;
+		buf[19] = rec->RxLen;
+
+		n = CAP_REC_SIZE;
+		memcpy(buf + n, rec->Tx, rec->TxLen);
+		n += rec->TxLen;
+		memcpy(buf + n, rec->Rx, rec->RxLen);
+		n += rec->RxLen;
+
+		if (write(fd, (char *) buf, n) != n) {
+			close(fd);
+			return ERROR;
+		}
+	}
+
+	return (close(fd) == ERROR) ? ERROR : OK;
+}
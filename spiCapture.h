@@ -0,0 +1,126 @@
+/*
+// ---------------------------------------------------------------
+// File: spiCapture.h
+//
+// Module: SPI bus analyzer capture.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPICAPTURE_H
+#define	SPICAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Capture limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_CAPTURE_MAX_BYTES	64	/* payload bytes kept per direction */
+
+
+/*
+// ---------------------------------------------------------------
+// Capture file format.
+// ---------------------------------------------------------------
+*/
+
+/*
+// All fields are big-endian.  The file header is followed by the
+// records, oldest first.
+//
+//	file header (20 bytes):
+//		u32 magic			SPI_CAPTURE_MAGIC
+//		u16 version			SPI_CAPTURE_VERSION
+//		u16 truncate		payload bytes kept per direction
+//		u32 freq			timestamp ticks per second
+//		u32 count			records in the file
+//		u32 lost			records overwritten before the save
+//
+//	record (20 bytes + TxLen + RxLen):
+//		u32 start			timestamp when the transfer started
+//		u32 end				timestamp when it completed
+//		u16 mode			SPMODE
+//		u16 cs				chip select identity (SPI_CMD.Cs)
+//		u16 txsize			bytes transmitted
+//		u16 rxsize			bytes received
+//		u8  id				control block
+//		u8  flags			SPI_CAPTURE_UNTIMED or 0
+//		u8  txlen			transmit bytes that follow
+//		u8  rxlen			receive bytes that follow
+//		txlen bytes			first transmitted bytes
+//		rxlen bytes			first received bytes
+//
+// The spidev backend hands a whole message to the kernel and learns
+// of its transfers only once it returns; its records are marked
+// SPI_CAPTURE_UNTIMED, with start and end both the time the
+// transfer was completed.
+*/
+
+#define SPI_CAPTURE_MAGIC		0x53504943	/* "SPIC" */
+#define SPI_CAPTURE_VERSION		1
+
+#define SPI_CAPTURE_UNTIMED		0x01	/* start and end not measured */
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+/* captured transfer */
+typedef struct {
+	UINT32 Start;		/* timestamp at start of transfer */
+	UINT32 End;			/* timestamp at receive complete */
+	UINT16 Mode;		/* SPMODE */
+	UINT16 Cs;			/* chip select identity */
+	UINT16 TxSize;		/* bytes transmitted */
+	UINT16 RxSize;		/* bytes received */
+	UINT8 Id;			/* control block */
+	UINT8 Flags;		/* SPI_CAPTURE_UNTIMED or 0 */
+	UINT8 TxLen;		/* transmit bytes kept */
+	UINT8 RxLen;		/* receive bytes kept */
+	UINT8 Tx[SPI_CAPTURE_MAX_BYTES];
+	UINT8 Rx[SPI_CAPTURE_MAX_BYTES];
+} SPI_CAPTURE_REC;
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern void spiCaptureBegin(SPI_CB *cb, SPI_CMD *cmd);
+extern void spiCaptureEnd(SPI_CB *cb, SPI_CMD *cmd);
+extern int spiCaptureSave(char *fileName);
+extern int spiCaptureStart(int records, int truncate);
+extern int spiCaptureStop(void);
+#else
+extern void spiCaptureBegin();
+extern void spiCaptureEnd();
+extern int spiCaptureSave();
+extern int spiCaptureStart();
+extern int spiCaptureStop();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPICAPTURE_H */
@@ -0,0 +1,398 @@
+/*
+// ---------------------------------------------------------------
+// File: spiCoro.h
+//
+// Module: SPI C++20 coroutine interface.
+//
+// Description: Awaitable SPI transactions for C++ clients, so
+//		that one task can drive many device conversations at
+//		once instead of parking a helper task in spiSync() for
+//		each of them.
+//
+// Operation: A spi::Executor belongs to the task that calls its
+//		run().  Coroutines returning spi::Task are started with
+//		spawn() and suspend in co_await on a spi::Session, which
+//		owns one control block from spiAllocate().  The
+//		transaction is scheduled SPI_ASYNC_ISR; its NotifyOp
+//		marks the control block ready in the executor and gives
+//		the executor's semaphore, and run() resumes the
+//		coroutine in the executor task.  Coroutines are only
+//		ever resumed by that task, so they need no locking
+//		among themselves.
+//
+//			spi::Task poll(spi::Session &s, int cs)
+//			{
+//				for (int ch = 0; ch < SPI_LTC1598_CHANNELS; ++ch) {
+//					spi::Result r = co_await s.ltc1598(cs, ch);
+//					...
+//				}
+//			}
+//
+//			spi::Executor ex;
+//			spi::Session a(ex), b(ex);
+//			ex.spawn(poll(a, 0));
+//			ex.spawn(poll(b, 1));
+//			ex.run();
+//
+//		Each session runs one transaction at a time; use one
+//		session per concurrent conversation.  Only C++20
+//		compilers see the contents of this header.  On a host,
+//		build spiLib with SPI_SPIDEV and point spiSpidevIoctl at
+//		a mock to run coroutines without a bus, as
+//		test/spiCoroTest.cpp does.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPICORO_H
+#define	SPICORO_H
+
+#if defined(__cplusplus) && (__cplusplus >= 202002L)
+
+#include <coroutine>
+#include <exception>
+#include "vxWorks.h"
+#include "semLib.h"
+#include "intLib.h"
+#include "spiLib.h"
+#include "spiLtc1598.h"
+#include "spiTempSensor.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Executor limits.
+// ---------------------------------------------------------------
+*/
+
+static_assert(SPI_MAX_CB <= 32, "ready mask holds one bit per control block");
+
+
+namespace spi {
+
+class Executor;
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+/* outcome of a transaction */
+struct Result {
+	int Error;			/* 0, or the control block Error */
+	int Value;			/* data read, for the device reads */
+};
+
+/* coroutine started by Executor::spawn() */
+struct Task {
+
+	struct promise_type {
+
+		Executor *Exec = nullptr;
+
+		Task get_return_object()
+		{
+			return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		struct Final {
+			bool await_ready() noexcept { return false; }
+			void await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+			void await_resume() noexcept {}
+		};
+
+		Final final_suspend() noexcept { return {}; }
+
+		void return_void() {}
+
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	std::coroutine_handle<promise_type> Handle;
+};
+
+
+/*
+// ---------------------------------------------------------------
+// Class: Executor
+//
+// Purpose: resume coroutines as their transactions complete.
+//
+// Description: Completions are posted at interrupt level as one
+//		bit per control block id; run() takes the whole mask
+//		under SPI_LOCK and resumes the coroutine waiting on each
+//		control block.  Waiting[] maps control block ids to the
+//		executor and coroutine, and is shared by all executors.
+//
+// Concurrency: run() and spawn() in the executor task only;
+//		post() at interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+class Executor {
+public:
+
+	Executor() : Sem(semBCreate(SEM_Q_FIFO, SEM_EMPTY)), Ready(0), Live(0) {}
+
+	~Executor() { semDelete(Sem); }
+
+	Executor(const Executor &) = delete;
+	Executor &operator=(const Executor &) = delete;
+
+	/* run t until its first co_await */
+	void spawn(Task t)
+	{
+		t.Handle.promise().Exec = this;
+		++Live;
+		t.Handle.resume();
+	}
+
+	/* resume coroutines until every spawned one has finished */
+	void run()
+	{
+		int iv;
+		int id;
+		unsigned int ready;
+		std::coroutine_handle<> h;
+
+		while (Live > 0) {
+
+			semTake(Sem, WAIT_FOREVER);
+
+			SPI_LOCK(iv);
+			ready = Ready;
+			Ready = 0;
+			SPI_UNLOCK(iv);
+
+			for (id = 0; ready; ++id, ready >>= 1) {
+				if ((ready & 1) && (h = Waiting[id].Handle)) {
+					Waiting[id].Handle = nullptr;
+					h.resume();
+				}
+			}
+		}
+	}
+
+	/* mark a control block complete, interrupt level */
+	void post(int id)
+	{
+		int iv;
+
+		SPI_LOCK(iv);
+		Ready = Ready | (1U << id);
+		SPI_UNLOCK(iv);
+
+		semGive(Sem);
+	}
+
+	/* coroutine waiting on each control block */
+	struct Waiter {
+		Executor *Exec;
+		std::coroutine_handle<> Handle;
+	};
+
+	static inline Waiter Waiting[SPI_MAX_CB];
+
+	/* NotifyOp of every coroutine transaction */
+	static int notify(SPI_CB *cb)
+	{
+		Executor *e = Waiting[cb->Id].Exec;
+
+		if (e)
+			e->post(cb->Id);
+
+		return OK;
+	}
+
+private:
+
+	friend struct Task::promise_type::Final;
+
+	SEM_ID Sem;
+	volatile unsigned int Ready;	/* completed control blocks, by id */
+	int Live;						/* spawned, not yet finished */
+};
+
+
+inline void
+Task::promise_type::Final::await_suspend(
+	std::coroutine_handle<promise_type> h) noexcept
+{
+	Executor *e = h.promise().Exec;
+
+	h.destroy();
+
+	if (e)
+		--e->Live;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Class: Transaction
+//
+// Purpose: awaitable SPI request.
+//
+// Description: The device reads format their commands into the
+//		awaiter itself when it suspends, since that is where it
+//		stays for as long as the coroutine waits.  Every request
+//		sets the key and preemption of the control block, so
+//		that neither is left over from the one before it.  A request
+//		that spiSched() refuses does not suspend the coroutine
+//		and completes with ERROR.
+//
+// Concurrency: Executor task.
+//
+// ---------------------------------------------------------------
+*/
+class Transaction {
+public:
+
+	enum Device { RAW, LTC1598, TEMPSENSOR };
+
+	Transaction(Executor &e, int id, Device dev, SPI_CMD *cmd, int ncmds,
+		int cs, int ch)
+		: Exec(e), Id(id), Dev(dev), Cmd(cmd), Ncmds(ncmds), Cs(cs), Ch(ch),
+		  Out{0, 0}, Data(0) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		switch (Dev) {
+
+		case LTC1598:
+			spiLtc1598Format(Inline, Cs, Ch, &Data);
+			spiSetPreempt(Id, FALSE);
+			spiSetKey(Id, SPI_KEY(SPI_KEY_LTC1598, Cs, Ch));
+			Cmd = Inline;
+			Ncmds = 2;
+			break;
+
+		case TEMPSENSOR:
+			spiTempSensorFormat(Inline, &Data);
+			spiSetPreempt(Id, TRUE);
+			spiSetKey(Id, SPI_KEY(SPI_KEY_TEMPSENSOR, 0, 0));
+			Cmd = Inline;
+			Ncmds = 1;
+			break;
+
+		default:
+			spiSetPreempt(Id, TRUE);
+			spiSetKey(Id, 0);
+			break;
+		}
+
+		Executor::Waiting[Id].Exec = &Exec;
+		Executor::Waiting[Id].Handle = h;
+
+		if (spiSched(Id, Cmd, Ncmds, SPI_ASYNC_ISR,
+			(FUNCPTR) Executor::notify) == ERROR) {
+			Executor::Waiting[Id].Handle = nullptr;
+			Out.Error = ERROR;
+			return false;
+		}
+
+		return true;
+	}
+
+	Result await_resume()
+	{
+		if (Out.Error == 0) {
+			Out.Error = SpiCB[Id].Error;
+			if ((Dev != RAW) && (Out.Error == 0))
+				Out.Value = SpiCB[Id].Value;
+		}
+
+		return Out;
+	}
+
+private:
+
+	Executor &Exec;
+	int Id;
+	Device Dev;
+	SPI_CMD *Cmd;
+	int Ncmds;
+	int Cs;
+	int Ch;
+	Result Out;
+	int Data;			/* PostOp target of the device reads */
+	SPI_CMD Inline[2];
+};
+
+
+/*
+// ---------------------------------------------------------------
+// Class: Session
+//
+// Purpose: control block owned by a coroutine conversation.
+//
+// Description: Allocates the control block once and frees it on
+//		destruction, like the ReadSession routines of the device
+//		drivers.  valid() is false if none was free.  Each
+//		transaction sets the single-flight key for what it
+//		reads, so a session can mix devices.
+//
+// Concurrency: Executor task; one transaction at a time.
+//
+// ---------------------------------------------------------------
+*/
+class Session {
+public:
+
+	explicit Session(Executor &e) : Exec(e), Id(spiAllocate()) {}
+
+	~Session()
+	{
+		if (Id != ERROR)
+			spiFree(Id);
+	}
+
+	Session(const Session &) = delete;
+	Session &operator=(const Session &) = delete;
+
+	bool valid() const { return Id != ERROR; }
+
+	int id() const { return Id; }
+
+	/* run caller's commands; they must outlive the co_await */
+	Transaction transact(SPI_CMD *cmd, int ncmds)
+	{
+		return Transaction(Exec, Id, Transaction::RAW, cmd, ncmds, 0, 0);
+	}
+
+	/* read an LTC1598 channel, as spiLtc1598Read() */
+	Transaction ltc1598(int ChipSelect, int Channel)
+	{
+		return Transaction(Exec, Id, Transaction::LTC1598, nullptr, 0,
+			ChipSelect, Channel);
+	}
+
+	/* read the temperature sensor, as spiTempSensorRead() */
+	Transaction tempSensor()
+	{
+		return Transaction(Exec, Id, Transaction::TEMPSENSOR, nullptr, 0,
+			0, 0);
+	}
+
+private:
+
+	Executor &Exec;
+	int Id;
+};
+
+}	/* namespace spi */
+
+#endif	/* __cplusplus >= 202002L */
+
+#endif	/* SPICORO_H */
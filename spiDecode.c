@@ -0,0 +1,418 @@
+/*
+// ---------------------------------------------------------------
+// File: spiDecode.c
+//
+// Module: SPI bulk sample decode.
+//
+// Description: Converts packed buffers of raw LTC1598 frames, as
+//		streamed or logged, into 12-bit values, optionally
+//		scaled to engineering units.
+//
+// Operation: The scalar routines are portable C and are what the
+//		68360 runs.  Host builds for x86-64 add an SSE2 path
+//		that decodes eight frames per step; frames left over at
+//		the end go through the scalar path.  Both use the same
+//		integer arithmetic, so they give bit-identical results
+//		for every input; spiDecodeBench() checks this and times
+//		them.
+//
+//		Scaling computes ((v * gain) >> shift) + offset with gain
+//		in 16 bits, so a conversion factor is given as a binary
+//		fraction: 2500 mV full scale over 4096 codes is gain
+//		20000, shift 15 (20000 / 32768 = 2500 / 4096).  The
+//		shift is arithmetic, rounding towards minus infinity.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "tickLib.h"
+#include "sysLib.h"
+#include "spiDecode.h"
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define SPI_DECODE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Forward declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void spiDecodeScalar(const char *raw, int n, UINT16 *out);
+LOCAL void spiDecodeScaledScalar(const char *raw, int n, int *out,
+	int gain, int shift, int offset);
+#ifdef SPI_DECODE_SSE2
+LOCAL int spiDecodeSse2(const char *raw, int n, UINT16 *out);
+LOCAL int spiDecodeScaledSse2(const char *raw, int n, int *out,
+	int gain, int shift, int offset);
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeLtc1598
+//
+// Purpose: decode a buffer of LTC1598 frames.
+//
+// Description: raw holds n frames of SPI_LTC1598_FRAME_SIZE
+//		bytes, as received.  raw and out need no alignment.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiDecodeLtc1598(const char *raw, int n, UINT16 *out)
+{
+	int done = 0;
+
+#ifdef SPI_DECODE_SSE2
+	done = spiDecodeSse2(raw, n, out);
+#endif
+
+	spiDecodeScalar(raw + SPI_LTC1598_FRAME_SIZE * done, n - done,
+		out + done);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeLtc1598Scaled
+//
+// Purpose: decode a buffer of LTC1598 frames to engineering units.
+//
+// Description: As spiDecodeLtc1598(), storing
+//		((v * gain) >> shift) + offset for each value v.  gain
+//		must lie in -32768 ... 32767 and shift in 0 ... 31.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiDecodeLtc1598Scaled(const char *raw, int n, int *out, int gain,
+	int shift, int offset)
+{
+	int done = 0;
+
+#ifdef SPI_DECODE_SSE2
+	done = spiDecodeScaledSse2(raw, n, out, gain, shift, offset);
+#endif
+
+	spiDecodeScaledScalar(raw + SPI_LTC1598_FRAME_SIZE * done, n - done,
+		out + done, gain, shift, offset);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeScalar
+//
+// Purpose: decode frames one at a time.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiDecodeScalar(const char *raw, int n, UINT16 *out)
+{
+	int i;
+
+	for (i = 0; i < n; ++i, raw += SPI_LTC1598_FRAME_SIZE)
+		out[i] = (UINT16) SPI_LTC1598_FRAME(raw[0], raw[1]);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeScaledScalar
+//
+// Purpose: decode and scale frames one at a time.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiDecodeScaledScalar(const char *raw, int n, int *out, int gain,
+	int shift, int offset)
+{
+	int i;
+
+	for (i = 0; i < n; ++i, raw += SPI_LTC1598_FRAME_SIZE)
+		out[i] = ((SPI_LTC1598_FRAME(raw[0], raw[1]) * gain) >> shift) +
+			offset;
+}
+
+
+#ifdef SPI_DECODE_SSE2
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeSse2
+//
+// Purpose: decode frames eight at a time.
+//
+// Description: Each 16-bit lane is loaded little-endian, so its
+//		bytes are swapped before the shift and mask of
+//		SPI_LTC1598_FRAME.
+//
+// Architecture: x86-64 hosts.
+//
+// Relationship:
+//
+// Returns: The number of frames decoded, a multiple of 8.
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiDecodeSse2(const char *raw, int n, UINT16 *out)
+{
+	int i;
+	__m128i x;
+	const __m128i mask = _mm_set1_epi16(0x0fff);
+
+	for (i = 0; i + 8 <= n; i += 8) {
+
+		x = _mm_loadu_si128((const __m128i *) (raw + 2 * i));
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		x = _mm_and_si128(_mm_srli_epi16(x, 1), mask);
+
+		_mm_storeu_si128((__m128i *) (out + i), x);
+	}
+
+	return i;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeScaledSse2
+//
+// Purpose: decode and scale frames eight at a time.
+//
+// Description: The 12-bit values and the 16-bit gain give exact
+//		32-bit products, assembled from the low and high halves
+//		of the 16-bit multiplies.
+//
+// Architecture: x86-64 hosts.
+//
+// Relationship:
+//
+// Returns: The number of frames decoded, a multiple of 8.
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiDecodeScaledSse2(const char *raw, int n, int *out, int gain, int shift,
+	int offset)
+{
+	int i;
+	__m128i x;
+	__m128i lo;
+	__m128i hi;
+	const __m128i mask = _mm_set1_epi16(0x0fff);
+	const __m128i g = _mm_set1_epi16((short) gain);
+	const __m128i off = _mm_set1_epi32(offset);
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+
+	for (i = 0; i + 8 <= n; i += 8) {
+
+		x = _mm_loadu_si128((const __m128i *) (raw + 2 * i));
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		x = _mm_and_si128(_mm_srli_epi16(x, 1), mask);
+
+		lo = _mm_mullo_epi16(x, g);
+		hi = _mm_mulhi_epi16(x, g);
+
+		_mm_storeu_si128((__m128i *) (out + i), _mm_add_epi32(
+			_mm_sra_epi32(_mm_unpacklo_epi16(lo, hi), sh), off));
+		_mm_storeu_si128((__m128i *) (out + i + 4), _mm_add_epi32(
+			_mm_sra_epi32(_mm_unpackhi_epi16(lo, hi), sh), off));
+	}
+
+	return i;
+}
+
+#endif	/* SPI_DECODE_SSE2 */
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDecodeBench
+//
+// Purpose: check and time the decode routines.
+//
+// Description: Decodes n random frames loops times with each
+//		routine, plain and scaled, prints the time per frame and
+//		compares the vector results with the scalar ones.  The
+//		scaled runs use gain -20000, shift 15, offset 1000 so
+//		that negative products are covered.  Times come from
+//		the system clock, so loops * n should be large enough
+//		to run for some ticks.
+//
+// Architecture:
+//
+// Relationship: Called from the shell.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiDecodeBench(int n, int loops)
+{
+	int i;
+	int t;
+	int bad;
+	char *raw;
+	UINT16 *out;
+	UINT16 *ref;
+	int *sout;
+	int *sref;
+
+	if ((n < 1) || (loops < 1))
+		return;
+
+	raw = (char *) malloc(SPI_LTC1598_FRAME_SIZE * n);
+	out = (UINT16 *) malloc(n * sizeof (UINT16));
+	ref = (UINT16 *) malloc(n * sizeof (UINT16));
+	sout = (int *) malloc(n * sizeof (int));
+	sref = (int *) malloc(n * sizeof (int));
+
+	if (!raw || !out || !ref || !sout || !sref)
+		goto done;
+
+	for (i = 0; i < SPI_LTC1598_FRAME_SIZE * n; ++i)
+		raw[i] = (char) rand();
+
+	/*
+	// -----------------------------------------------------------
+	// scalar reference.
+	// -----------------------------------------------------------
+	*/
+
+	t = tickGet();
+	for (i = 0; i < loops; ++i)
+		spiDecodeScalar(raw, n, ref);
+	t = tickGet() - t;
+
+	printf("%-16s %10d nsec per 1000 frames\n", "scalar",
+		(int) ((double) t * 1e12 / sysClkRateGet() / loops / n));
+
+	t = tickGet();
+	for (i = 0; i < loops; ++i)
+		spiDecodeScaledScalar(raw, n, sref, -20000, 15, 1000);
+	t = tickGet() - t;
+
+	printf("%-16s %10d nsec per 1000 frames\n", "scalar scaled",
+		(int) ((double) t * 1e12 / sysClkRateGet() / loops / n));
+
+	/*
+	// -----------------------------------------------------------
+	// dispatching routines, vector where available.
+	// -----------------------------------------------------------
+	*/
+
+	t = tickGet();
+	for (i = 0; i < loops; ++i)
+		spiDecodeLtc1598(raw, n, out);
+	t = tickGet() - t;
+
+	printf("%-16s %10d nsec per 1000 frames\n", "bulk",
+		(int) ((double) t * 1e12 / sysClkRateGet() / loops / n));
+
+	t = tickGet();
+	for (i = 0; i < loops; ++i)
+		spiDecodeLtc1598Scaled(raw, n, sout, -20000, 15, 1000);
+	t = tickGet() - t;
+
+	printf("%-16s %10d nsec per 1000 frames\n", "bulk scaled",
+		(int) ((double) t * 1e12 / sysClkRateGet() / loops / n));
+
+	/*
+	// -----------------------------------------------------------
+	// the results must match bit for bit.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0, bad = 0; i < n; ++i)
+		if ((out[i] != ref[i]) || (sout[i] != sref[i]))
+			++bad;
+
+	printf("%d of %d frames differ\n", bad, n);
+
+done:
+	free(raw);
+	free(out);
+	free(ref);
+	free(sout);
+	free(sref);
+}
@@ -0,0 +1,67 @@
+/*
+// ---------------------------------------------------------------
+// File: spiDecode.h
+//
+// Module: SPI bulk sample decode.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPIDECODE_H
+#define	SPIDECODE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// LTC1598 frame format.
+// ---------------------------------------------------------------
+*/
+
+/*
+// An LTC1598 conversion arrives as a 2-byte frame, first byte
+// first on the wire: three leading bits (the null bit among them),
+// the 12-bit result MSB first and one trailing bit.
+// SPI_LTC1598_FRAME decodes one frame from its two bytes without
+// depending on host byte order.
+*/
+
+#define SPI_LTC1598_FRAME_SIZE	2
+
+#define SPI_LTC1598_FRAME(b0, b1) \
+	((((((b0) & 0xff) << 8) | ((b1) & 0xff)) >> 1) & 0x0fff)
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern void spiDecodeBench(int n, int loops);
+extern void spiDecodeLtc1598(const char *raw, int n, UINT16 *out);
+extern void spiDecodeLtc1598Scaled(const char *raw, int n, int *out,
+	int gain, int shift, int offset);
+#else
+extern void spiDecodeBench();
+extern void spiDecodeLtc1598();
+extern void spiDecodeLtc1598Scaled();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPIDECODE_H */
@@ -0,0 +1,225 @@
+/*
+// ---------------------------------------------------------------
+// File: spiFilter.c
+//
+// Module: SPI sample filter chain.
+//
+// Description: Median spike rejection, boxcar decimation and a
+//		short FIR in fixed point, run per channel on the
+//		acquisition path so that consumers only see filtered
+//		values, one per decimation period.
+//
+// Operation: spiFilterInit() checks a configuration and resets
+//		the state; spiFilterPut() feeds one sample and says
+//		whether the chain produced an output.  The state is the
+//		caller's and nothing is locked or allocated, so the
+//		chain can run at interrupt level.
+//
+//		The decimator is a first order CIC, i.e. a boxcar: the
+//		mean of Decim samples, rounded.  The FIR runs at the
+//		decimated rate with Q15 coefficients and a rounded
+//		result.  Until the median window has filled the median
+//		is taken over the samples seen so far, and the FIR delay
+//		line starts out as zeros.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "string.h"
+#include "spiFilter.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Forward declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int spiFilterMedian(SPI_FILTER *f, int x);
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiFilterInit
+//
+// Purpose: set up a filter chain.
+//
+// Description: Copies the configuration and clears the state.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if a stage size is out of range or the
+//		median window is even.
+//
+// Exception:
+//
+// Concurrency: Task level; the chain must not be in use.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiFilterInit(SPI_FILTER *f, const SPI_FILTER_CFG *cfg)
+{
+	if ((cfg->Median < 0) || (cfg->Median > SPI_FILTER_MAX_MEDIAN) ||
+		(cfg->Median && !(cfg->Median & 1)))
+		return ERROR;
+
+	if ((cfg->Decim < 0) || (cfg->Decim > SPI_FILTER_MAX_DECIM))
+		return ERROR;
+
+	if ((cfg->Taps < 0) || (cfg->Taps > SPI_FILTER_MAX_TAPS))
+		return ERROR;
+
+	memset((char *) f, 0, sizeof (*f));
+	f->Cfg = *cfg;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiFilterPut
+//
+// Purpose: feed one sample to a filter chain.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: TRUE with the output in *y once every Decim samples,
+//		otherwise FALSE.
+//
+// Exception:
+//
+// Concurrency: Interrupt or task level; one caller per chain.
+//
+// ---------------------------------------------------------------
+*/
+BOOL
+spiFilterPut(SPI_FILTER *f, int x, int *y)
+{
+	int i;
+	int k;
+	int acc;
+	int n;
+
+	/*
+	// -----------------------------------------------------------
+	// median spike rejection.
+	// -----------------------------------------------------------
+	*/
+
+	if (f->Cfg.Median > 1)
+		x = spiFilterMedian(f, x);
+
+	/*
+	// -----------------------------------------------------------
+	// boxcar decimation.
+	// -----------------------------------------------------------
+	*/
+
+	if ((n = f->Cfg.Decim) > 1) {
+
+		f->Sum += x;
+
+		if (++f->SumCount < n)
+			return FALSE;
+
+		x = (f->Sum >= 0) ? (f->Sum + n / 2) / n : -((n / 2 - f->Sum) / n);
+
+		f->Sum = 0;
+		f->SumCount = 0;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// FIR, newest sample against Coef[0].
+	// -----------------------------------------------------------
+	*/
+
+	if ((n = f->Cfg.Taps) > 0) {
+
+		f->Line[f->LineNext] = x;
+
+		for (acc = 0, i = 0, k = f->LineNext; i < n; ++i) {
+			acc += f->Cfg.Coef[i] * f->Line[k];
+			if (--k < 0)
+				k = n - 1;
+		}
+
+		if (++f->LineNext >= n)
+			f->LineNext = 0;
+
+		x = (acc + (1 << (SPI_FILTER_FRAC - 1))) >> SPI_FILTER_FRAC;
+	}
+
+	*y = x;
+
+	return TRUE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiFilterMedian
+//
+// Purpose: median of the window after adding a sample.
+//
+// Description: Sorts a copy of the window by insertion, which is
+//		the cheapest for at most SPI_FILTER_MAX_MEDIAN values.
+//
+// Architecture:
+//
+// Relationship: Called by spiFilterPut().
+//
+// Returns: The median; the lower of the two middle values while
+//		the window holds an even number of samples.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiFilterMedian(SPI_FILTER *f, int x)
+{
+	int s[SPI_FILTER_MAX_MEDIAN];
+	int i;
+	int j;
+	int v;
+
+	f->Win[f->WinNext] = x;
+
+	if (++f->WinNext >= f->Cfg.Median)
+		f->WinNext = 0;
+
+	if (f->WinCount < f->Cfg.Median)
+		f->WinCount++;
+
+	for (i = 0; i < f->WinCount; ++i) {
+		v = f->Win[i];
+		for (j = i; (j > 0) && (s[j - 1] > v); --j)
+			s[j] = s[j - 1];
+		s[j] = v;
+	}
+
+	return s[(f->WinCount - 1) / 2];
+}
@@ -0,0 +1,91 @@
+/*
+// ---------------------------------------------------------------
+// File: spiFilter.h
+//
+// Module: SPI sample filter chain.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPIFILTER_H
+#define	SPIFILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Filter limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_FILTER_MAX_MEDIAN	7	/* median window, odd */
+#define SPI_FILTER_MAX_DECIM	256	/* boxcar decimation factor */
+#define SPI_FILTER_MAX_TAPS		16	/* FIR taps */
+#define SPI_FILTER_FRAC			15	/* FIR taps are Q15 */
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+/*
+// Samples pass the median window first, then the boxcar
+// decimator, then the FIR at the decimated rate; each stage is
+// off when its size is 0 (or 1).  Inputs are 12-bit conversions,
+// or any values within +-4095, for which the Q15 FIR cannot
+// overflow.
+*/
+
+/* filter chain configuration */
+typedef struct {
+	int Median;			/* median window, 0 or odd up to the max */
+	int Decim;			/* samples averaged per output, 0 or 1 = all */
+	int Taps;			/* FIR taps used, 0 = no FIR */
+	short Coef[SPI_FILTER_MAX_TAPS];	/* Q15 coefficients */
+} SPI_FILTER_CFG;
+
+/* filter chain state */
+typedef struct {
+	SPI_FILTER_CFG Cfg;
+	int Win[SPI_FILTER_MAX_MEDIAN];	/* median window, ring */
+	int WinNext;		/* next slot in Win */
+	int WinCount;		/* samples in Win */
+	int Sum;			/* boxcar sum */
+	int SumCount;		/* samples in Sum */
+	int Line[SPI_FILTER_MAX_TAPS];	/* FIR delay line, ring */
+	int LineNext;		/* next slot in Line */
+} SPI_FILTER;
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern int spiFilterInit(SPI_FILTER *f, const SPI_FILTER_CFG *cfg);
+extern BOOL spiFilterPut(SPI_FILTER *f, int x, int *y);
+#else
+extern int spiFilterInit();
+extern BOOL spiFilterPut();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPIFILTER_H */
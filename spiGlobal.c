@@ -35,6 +35,10 @@
 SPI_HDR SpiHdr;
 SPI_STAT SpiStat;
 SPI_CB SpiCB[SPI_MAX_CB];
+SPI_CLIENT SpiClient[SPI_MAX_CLIENTS];
+#ifdef _WRS_CONFIG_SMP
+spinlockIsr_t spiLock;
+#endif
 
 int SpiMaxCB = SPI_MAX_CB;
 int	spiPriority = 2;
@@ -43,6 +47,14 @@ int	spiStackSize = 8000;
 int spiDebug = 0;
 int spiMsgTimeout = WAIT_FOREVER;
 int spiWdgTimeout = 5000;
+int spiClockMHz = 25;
+int spiCmdOverhead = 100;
+int spiFairUnits = SPI_FAIR_BYTES;
+int spiFairQuantum = 16;
+
+FUNCPTR spiStartHook = 0;
+FUNCPTR spiDoneHook = 0;
+FUNCPTR spiValueHook = 0;
 
 char spiTxBuffer[SPI_BUFFER_SIZE];
 char spiRxBuffer[SPI_BUFFER_SIZE];
@@ -53,9 +53,16 @@
 #include "iosLib.h"
 #include "intLib.h"
 #include "logLib.h"
+#include "tickLib.h"
+#include "sysLib.h"
+#include "errnoLib.h"
 #include "spiLib.h"
+#ifdef SPI_SPIDEV
+#include "spiSpidev.h"
+#else
 #include "config.h"
 #include "m68360.h"
+#endif
 
 
 /*
@@ -69,8 +76,21 @@
 	(cb)->Return = 0; \
 	(cb)->Error = 0; \
 	(cb)->Priority = 0; \
+	(cb)->RunPriority = 0; \
 	(cb)->Count = 0; \
 	(cb)->SyncMode = 0; \
+	(cb)->Flags = 0; \
+	(cb)->Burst = 0; \
+	(cb)->BurstLeft = 0; \
+	(cb)->Client = 0; \
+	(cb)->Deadline = 0; \
+	(cb)->Work = 0; \
+	(cb)->Delay = 0; \
+	(cb)->Key = 0; \
+	(cb)->Value = 0; \
+	(cb)->Leader = 0; \
+	(cb)->Join = 0; \
+	(cb)->Joined = 0; \
 	(cb)->Next = 0; \
 	(cb)->Cmd = 0; \
 }
@@ -85,6 +105,12 @@
 	(cb)->Next = 0; \
 }
 
+#define CB_PUSH(h, cb)	{ \
+	if (((cb)->Next = (h)->CBHead) == 0L) \
+		(h)->CBTail = (cb); \
+	(h)->CBHead = (cb); \
+}
+
 #define CB_SCHED(h)	{ \
 	if (((h)->RunCB = (h)->CBHead) != 0L) { \
 		(h)->CBHead = (h)->CBHead->Next; \
@@ -102,6 +128,41 @@
 */
 
 
+/*
+// ---------------------------------------------------------------
+// Forward declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int spiSchedCB(int id, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op,
+	int deadline, BOOL due);
+LOCAL void spiSchedSetup(SPI_CB *cb, SPI_CMD *cmd, int ncmds, int mode,
+	FUNCPTR op, int deadline, BOOL due);
+LOCAL BOOL spiSubmitPush(SPI_HDR *h, SPI_CB *first, SPI_CB *last);
+LOCAL void spiSubmitDrain(SPI_HDR *h);
+LOCAL void spiSubmitOne(SPI_HDR *h, SPI_CB *cb);
+LOCAL void spiSubmitKick(SPI_HDR *h);
+
+#ifndef SPI_SPIDEV
+LOCAL void spiCsOn(SPI_HDR *h, SPI_CB *cb, SPI_CMD *cmd);
+LOCAL void spiCsOff(SPI_HDR *h, SPI_CB *cb, SPI_CMD *cmd);
+#endif
+LOCAL void spiCsRelease(SPI_HDR *h);
+LOCAL void spiDequeue(SPI_HDR *h, SPI_CB *cb);
+LOCAL void spiDelay(SPI_HDR *h, SPI_CB *cb);
+LOCAL SPI_CB *spiJoinFind(int key);
+LOCAL void spiJoinRemove(SPI_CB *cb);
+LOCAL void spiJoinPromote(SPI_HDR *h, SPI_CB *cb);
+LOCAL void spiJoinFinish(SPI_CB *cb);
+LOCAL void spiSchedNext(SPI_HDR *h);
+LOCAL BOOL spiTopPriority(SPI_HDR *h, int *prio);
+LOCAL SPI_CB *spiFairSelect(SPI_HDR *h, int prio);
+LOCAL SPI_CB *spiEdfSelect(SPI_HDR *h, int prio);
+LOCAL int spiCmdWork(SPI_CMD *cmd, int ncmds);
+LOCAL int spiAdmitLate(SPI_HDR *h, int work, int deadline, int prio);
+LOCAL int spiAdmitFinish(SPI_HDR *h, int work, int deadline, int prio);
+
+
 /*
 // ---------------------------------------------------------------
 // Local variables.
@@ -138,7 +199,17 @@ int
 spiInit(void)
 {
 	int i;
+#ifndef SPI_SPIDEV
 	int lvl;
+#endif
+
+#ifdef _WRS_CONFIG_SMP
+	spinLockIsrInit(&spiLock, 0);
+#endif
+
+#ifdef SPI_PROFILE
+	spiProfReset();
+#endif
 
 	/*
 	// -----------------------------------------------------------
@@ -153,7 +224,20 @@ spiInit(void)
 		SpiCB[i].Return = 0;
 		SpiCB[i].Error = 0;
 		SpiCB[i].Priority = 0;
+		SpiCB[i].RunPriority = 0;
 		SpiCB[i].Count = 0;
+		SpiCB[i].Flags = 0;
+		SpiCB[i].Burst = 0;
+		SpiCB[i].BurstLeft = 0;
+		SpiCB[i].Client = 0;
+		SpiCB[i].Deadline = 0;
+		SpiCB[i].Work = 0;
+		SpiCB[i].Delay = 0;
+		SpiCB[i].Key = 0;
+		SpiCB[i].Value = 0;
+		SpiCB[i].Leader = 0L;
+		SpiCB[i].Join = 0L;
+		SpiCB[i].Joined = 0;
 		SpiCB[i].Next = 0L;
 		SpiCB[i].Cmd = 0;
 		SpiCB[i].sem = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
@@ -161,6 +245,19 @@ spiInit(void)
 			return ERROR;
 	}
 
+	/*
+	// -----------------------------------------------------------
+	// initialize SPI fair share clients.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0; i < SPI_MAX_CLIENTS; ++i) {
+		SpiClient[i].Tid = 0;
+		SpiClient[i].Weight = 1;
+		SpiClient[i].Deficit = 0;
+		SpiClient[i].Served = 0;
+	}
+
 	/*
 	// -----------------------------------------------------------
 	// initialize SPI device headers.
@@ -169,24 +266,47 @@ spiInit(void)
 
 	SpiHdr.State = SPIDEV_STATE_IDLE;
 	SpiHdr.RunCB = 0L;
+	SpiHdr.Submit = 0L;
 	SpiHdr.CBHead = 0L;
 	SpiHdr.CBTail = 0L;
+	SpiHdr.DelayCB = 0L;
+	SpiHdr.HoldCB = 0L;
+	SpiHdr.HoldCsOff = 0;
+	SpiHdr.Policy = SPI_SCHED_FIFO;
+	SpiHdr.Client = 0;
+
+	SpiHdr.DeferHead = 0;
+	SpiHdr.DeferTail = 0;
+	SpiHdr.PendHead = 0;
+	SpiHdr.PendTail = 0;
+	SpiHdr.DeferPending = 0;
+	SpiHdr.DeferKick = FALSE;
+	SpiHdr.NLate = 0;
+
+	SpiHdr.defer = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+	if (SpiHdr.defer == NULL)
+		return ERROR;
 
-	SpiHdr.mq = msgQCreate(SPI_MAX_MSGS, sizeof(SPI_MSG), MSG_Q_FIFO);
-	if (SpiHdr.mq == NULL)
+	SpiHdr.wd = wdCreate();
+	if (SpiHdr.wd == NULL)
 		return ERROR;
 
-#if 0
 	SpiHdr.tid = taskSpawn("spiDaemon", spiPriority, spiOptions, spiStackSize,
 		(FUNCPTR) spiDaemon, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 	if (SpiHdr.tid == ERROR)
 		return ERROR;
-#endif
 
-	SpiHdr.mutex =
-		semMCreate(SEM_Q_PRIORITY|SEM_DELETE_SAFE|SEM_INVERSION_SAFE);
-	if (SpiHdr.mutex == NULL)
-		return ERROR;
+#ifdef SPI_SPIDEV
+
+	/*
+	// -----------------------------------------------------------
+	// transfers go through the Linux spidev driver.
+	// -----------------------------------------------------------
+	*/
+
+	return spiSpidevInit(&SpiHdr);
+
+#else
 
 	/*
 	// -----------------------------------------------------------
@@ -254,6 +374,8 @@ spiInit(void)
 	intUnlock(lvl);
 
 	return OK;
+
+#endif	/* SPI_SPIDEV */
 }
 
 
@@ -265,39 +387,202 @@ spiInit(void)
 //
 // Description: This routine allows interrupt level code to request
 //		a function call to be made by spidaemon at task-level.
+//		The request goes into a fixed-size ring that the daemon
+//		drains; interrupt level never blocks and the daemon
+//		never locks interrupts to take requests.
 //
-// Architecture:
+// Architecture: Producers are serialized by SPI_LOCK; the record
+//		is filled in before DeferHead is advanced, and the daemon
+//		advances DeferTail only after it has copied the record.
 //
-// Relationship:
+// Relationship: Control block completions that do not fit are
+//		not lost: spiNotify() queues them in SpiHdr.Pend
+//		instead.
 //
-// Returns:
+// Returns: OK, or ERROR if the ring is full.
 //
 // Exception:
 //
-// Concurrency:
+// Concurrency: Interrupt or task level, without SPI_LOCK held.
 //
 // ---------------------------------------------------------------
 */
 int
 spiDefer(FUNCPTR Function, int Arg1, int Arg2)
 {
-	SPI_MSG m;
-
-	m.Function = Function;
-	m.Arg[0] = Arg1;
-	m.Arg[1] = Arg2;
+	int iv;
+	int ret;
 
-	if (msgQSend(SpiHdr.mq, (char *) &m, sizeof (m),
-		INT_CONTEXT() ? NO_WAIT : WAIT_FOREVER, MSG_PRI_NORMAL) != OK) {
+	SPI_LOCK(iv);
+	ret = spiDeferLocked(Function, Arg1, Arg2);
+	SPI_UNLOCK(iv);
 
+	if (ret == ERROR) {
 		++SpiStat.spiMsgsLost;
 		return ERROR;
 	}
 
+	semGive(SpiHdr.defer);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDeferLocked
+//
+// Purpose: add a deferred call with SPI_LOCK already held.
+//
+// Description: As spiDefer(), but neither takes the lock nor wakes
+//		the daemon; the caller gives SpiHdr.defer once it has
+//		released the lock.  Code that runs under a lock taken by
+//		someone else, such as a PostOp, relies on the lock holder
+//		calling spiDeferFlush() after the unlock instead.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if the ring is full.
+//
+// Exception:
+//
+// Concurrency: Under SPI_LOCK or SPI_ISR_LOCK.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiDeferLocked(FUNCPTR Function, int Arg1, int Arg2)
+{
+	unsigned int head;
+	SPI_DEFER *d;
+
+	head = SpiHdr.DeferHead;
+
+	if ((head - SpiHdr.DeferTail) >= SPI_MAX_DEFER)
+		return ERROR;
+
+	d = SpiHdr.Defer + (head & (SPI_MAX_DEFER - 1));
+	d->Function = Function;
+	d->Arg1 = Arg1;
+	d->Arg2 = Arg2;
+
+	SPI_BARRIER_W();
+
+	SpiHdr.DeferHead = head + 1;
+	SpiHdr.DeferKick = TRUE;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDeferIsrLocked
+//
+// Purpose: add an interrupt level call to make after the unlock.
+//
+// Description: Records Function(Arg1, Arg2) to be called by the
+//		next spiDeferFlush(), at the level of the code that
+//		released the lock but no longer under it, so that the
+//		call may give semaphores and use spiLib like an
+//		SPI_ASYNC_ISR notification.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if SPI_MAX_DEFER calls are already waiting.
+//
+// Exception:
+//
+// Concurrency: Under SPI_LOCK or SPI_ISR_LOCK.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiDeferIsrLocked(FUNCPTR Function, int Arg1, int Arg2)
+{
+	SPI_DEFER *d;
+
+	if (SpiHdr.NLate >= SPI_MAX_DEFER)
+		return ERROR;
+
+	d = SpiHdr.Late + SpiHdr.NLate;
+	d->Function = Function;
+	d->Arg1 = Arg1;
+	d->Arg2 = Arg2;
+
+	SpiHdr.NLate++;
+
 	return OK;
 }
 
 
+/*
+// ---------------------------------------------------------------
+// Function: spiDeferFlush
+//
+// Purpose: deliver what was deferred under the lock.
+//
+// Description: Wakes the daemon if spiDeferLocked() added to the
+//		ring, then makes the calls recorded by
+//		spiDeferIsrLocked(), in order.  SPI_SPIDEV builds also
+//		wake the transfer task if spiStart() was called under
+//		the lock.
+//
+// Architecture: The flags are read without the lock: records
+//		added on this CPU under the lock just released are
+//		seen, and another CPU flushes its own after its unlock.
+//
+// Relationship: Called after each unlock that may have run
+//		PostOps or started the bus.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt or task level, without SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiDeferFlush(void)
+{
+	int iv;
+	int i;
+	int n;
+	BOOL kick;
+	SPI_DEFER late[SPI_MAX_DEFER];
+
+#ifdef SPI_SPIDEV
+	spiSpidevWake();
+#endif
+
+	if (!SpiHdr.DeferKick && (SpiHdr.NLate == 0))
+		return;
+
+	SPI_LOCK(iv);
+
+	kick = SpiHdr.DeferKick;
+	SpiHdr.DeferKick = FALSE;
+
+	n = SpiHdr.NLate;
+	for (i = 0; i < n; ++i)
+		late[i] = SpiHdr.Late[i];
+	SpiHdr.NLate = 0;
+
+	SPI_UNLOCK(iv);
+
+	if (kick)
+		semGive(SpiHdr.defer);
+
+	for (i = 0; i < n; ++i)
+		(*late[i].Function)(late[i].Arg1, late[i].Arg2);
+}
+
+
 /*
 // ---------------------------------------------------------------
 // Function: spiDaemon
@@ -328,8 +613,9 @@ void
 spiDaemon(void)
 {
 	int iv;
-	SPI_MSG m;
-	extern int tickGet();
+	int n;
+	unsigned int tail;
+	SPI_DEFER d;
 
 	SpiHdr.LastTick = tickGet();
 	SpiHdr.Interval = spiWdgTimeout;
@@ -340,40 +626,80 @@ spiDaemon(void)
 
 		/*
 		// -------------------------------------------------------
-		// wait for a message to arrive or timeout.
+		// wait for deferred calls or timeout.
 		// -------------------------------------------------------
 		*/
 
-		if (msgQReceive(SpiHdr.mq,
-			(char *) &m, sizeof (m), spiMsgTimeout) != sizeof (m)) {
+		if (semTake(SpiHdr.defer, spiMsgTimeout) != OK) {
 
 			SPIDEBUG(("spiDaemon: timed out, status = %#x\n",
 				errno, 0, 0, 0, 0, 0));
+		}
 
-			printf("DAEMON---TIMED OUT\n");
-
-		} else {
+		/*
+		// -------------------------------------------------------
+		// drain every call queued since the last wake-up.
+		// -------------------------------------------------------
+		*/
 
-			printf("DAEMON---RECEIVED MESSAGE\n");
+		for (n = 0, tail = SpiHdr.DeferTail; tail != SpiHdr.DeferHead;
+			 ++n, ++tail) {
 
-			(*m.Function)(m.Arg[0], m.Arg[1]);
+			SPI_BARRIER_R();
+			d = SpiHdr.Defer[tail & (SPI_MAX_DEFER - 1)];
+			SPI_BARRIER_RW();
+			SpiHdr.DeferTail = tail + 1;
 
-			/*
-			// ---------------------------------------------------
-			// check to see if interrupt lost any more calls.
-			// ---------------------------------------------------
-			*/
+			(*d.Function)(d.Arg1, d.Arg2);
+		}
 
-			SpiStat.newMsgsLost = SpiStat.spiMsgsLost;
+		/*
+		// -------------------------------------------------------
+		// then the completions that overflowed the ring, oldest
+		// first.  A record stays in Pend until it has been
+		// delivered, so that later completions queue behind it.
+		// -------------------------------------------------------
+		*/
 
-			if (SpiStat.newMsgsLost != SpiStat.oldMsgsLost) {
+		for (;;) {
 
-				SPIDEBUG(("spiDaemon: lost %d msgs from interrupt.\n",
-					SpiStat.newMsgsLost - SpiStat.oldMsgsLost,
-					0, 0, 0, 0, 0));
+			SPI_LOCK(iv);
 
-				SpiStat.oldMsgsLost = SpiStat.newMsgsLost;
+			if (SpiHdr.PendTail == SpiHdr.PendHead) {
+				SPI_UNLOCK(iv);
+				break;
 			}
+
+			d = SpiHdr.Pend[SpiHdr.PendTail % SPI_MAX_CB];
+
+			SPI_UNLOCK(iv);
+
+			(*d.Function)(d.Arg1, d.Arg2);
+
+			SPI_LOCK(iv);
+			SpiHdr.PendTail++;
+			SpiHdr.DeferPending &= ~(1 << d.Arg1);
+			SPI_UNLOCK(iv);
+		}
+
+		if (n)
+			SPIDEBUG(("spiDaemon: %d deferred calls\n", n, 0, 0, 0, 0, 0));
+
+		/*
+		// -------------------------------------------------------
+		// check to see if interrupt lost any more calls.
+		// -------------------------------------------------------
+		*/
+
+		SpiStat.newMsgsLost = SpiStat.spiMsgsLost;
+
+		if (SpiStat.newMsgsLost != SpiStat.oldMsgsLost) {
+
+			SPIDEBUG(("spiDaemon: lost %d msgs from interrupt.\n",
+				SpiStat.newMsgsLost - SpiStat.oldMsgsLost,
+				0, 0, 0, 0, 0));
+
+			SpiStat.oldMsgsLost = SpiStat.newMsgsLost;
 		}
 
 		/*
@@ -393,9 +719,9 @@ spiDaemon(void)
 			// ---------------------------------------------------
 			*/
 
-			iv = intLock();
+			SPI_LOCK(iv);
 
-			if (SpiHdr.State == SPIDEV_STATE_BUSY) {
+			if ((SpiHdr.State == SPIDEV_STATE_BUSY) && SpiHdr.RunCB) {
 
 				if (SpiHdr.IsStalled == FALSE) {
 
@@ -426,8 +752,10 @@ spiDaemon(void)
 
 						SpiHdr.StalledIndex = SpiHdr.RunCB->Index;
 
+#ifndef SPI_SPIDEV
 						*M360_CPM_SPMODE(M_ADRS) =
 							(*M360_CPM_SPMODE(M_ADRS) & 0xfff0) | 0x0800;
+#endif
 
 					} else {
 
@@ -441,11 +769,11 @@ spiDaemon(void)
 						SpiHdr.IsStalled = FALSE;
 						SpiHdr.StalledIndex = -1;
 
-						intUnlock(iv);
+						SPI_UNLOCK(iv);
 
 						spiCancel(SpiHdr.RunCB->Id);
 
-						iv = intLock();
+						SPI_LOCK(iv);
 					}
 				}
 
@@ -454,7 +782,7 @@ spiDaemon(void)
 				SpiHdr.IsStalled = TRUE;
 			}
 
-			intUnlock(iv);
+			SPI_UNLOCK(iv);
 
 			/*
 			// ---------------------------------------------------
@@ -472,15 +800,21 @@ spiDaemon(void)
 // ---------------------------------------------------------------
 // Function: spiAllocate
 //
-// Purpose:
+// Purpose: allocate a control block.
 //
-// Description:
+// Description: The control block stays with the caller until
+//		spiFree(), and may be scheduled any number of times in
+//		between, one request at a time.  Clients that read at a
+//		high rate keep one as a session (see the ReadSession
+//		routines of the device drivers) rather than allocate and
+//		free one per request.  Priority, preemption, burst and
+//		key settings persist from one request to the next.
 //
 // Architecture:
 //
 // Relationship:
 //
-// Returns:
+// Returns: control block id, or ERROR if none is free.
 //
 // Exception:
 //
@@ -493,35 +827,42 @@ spiAllocate(void)
 {
 	register SPI_CB *cb = SpiCB;
 	int i;
+	int c;
+	int iv;
+	int tid = taskIdSelf();
 
 	/*
 	// -----------------------------------------------------------
-	// acquire exclusive access to spi library routine.
+	// search for available control block and claim it.
 	// -----------------------------------------------------------
 	*/
 
-	semTake(SpiHdr.mutex, WAIT_FOREVER);
-
-	/*
-	// -----------------------------------------------------------
-	// search for available control block.
-	// -----------------------------------------------------------
-	*/
+	SPI_LOCK(iv);
 
 	for (cb = SpiCB, i = 0; i < SpiMaxCB; ++i, ++cb) {
 		if (cb->State == SPICB_STATE_FREE) {
 			CB_CLEAR(cb);
+			cb->State = SPICB_STATE_ALLOC;
 			break;
 		}
 	}
 
+	SPI_UNLOCK(iv);
+
 	/*
 	// -----------------------------------------------------------
-	// release spi library semaphore.
+	// charge the control block to the caller's fair share client.
 	// -----------------------------------------------------------
 	*/
 
-	semGive(SpiHdr.mutex);
+	if (i < SpiMaxCB) {
+		for (c = 0; c < SPI_MAX_CLIENTS; ++c) {
+			if (SpiClient[c].Tid == tid) {
+				cb->Client = c;
+				break;
+			}
+		}
+	}
 
 	return (i >= SpiMaxCB) ? -1 : i;
 }
@@ -550,19 +891,12 @@ spiAllocate(void)
 int
 spiFree(int id)
 {
+	int iv;
 	SPI_CB *cb;
 
 	if ((id < 0) || (id >= SpiMaxCB))
 		return ERROR;
 
-	/*
-	// -----------------------------------------------------------
-	// acquire exclusive access to spi library routine.
-	// -----------------------------------------------------------
-	*/
-
-	semTake(SpiHdr.mutex, WAIT_FOREVER);
-
 	/*
 	// -----------------------------------------------------------
 	// free control block.
@@ -570,16 +904,16 @@ spiFree(int id)
 	*/
 
 	cb = SpiCB + id;
-	cb->State = SPICB_STATE_FREE;
-	CB_CLEAR(cb);
 
-	/*
-	// -----------------------------------------------------------
-	// release spi library semaphore.
-	// -----------------------------------------------------------
-	*/
+	SPI_LOCK(iv);
+
+	if (cb->State == SPICB_STATE_JOIN)
+		spiJoinRemove(cb);
 
-	semGive(SpiHdr.mutex);
+	CB_CLEAR(cb);
+	cb->State = SPICB_STATE_FREE;
+
+	SPI_UNLOCK(iv);
 
 	return OK;
 }
@@ -607,8 +941,98 @@ spiFree(int id)
 */
 int
 spiSched(int id, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op)
+{
+	return spiSchedCB(id, cmd, ncmds, mode, op, 0, FALSE);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSchedDeadline
+//
+// Purpose: schedule a control block that must finish by a deadline.
+//
+// Description: Same as spiSched(), with an absolute deadline in
+//		ticks.  Every tick count is a deadline, 0 included, so a
+//		deadline computed from tickGet() keeps its guarantee
+//		when it wraps.  Under SPI_SCHED_EDF the run queue
+//		is served earliest deadline first.  Before anything is
+//		queued the admission check of spiAdmit(), at the
+//		priority of the control block, makes sure that the work
+//		ahead of the control block plus its own
+//		estimated wire time can complete by the deadline; if not
+//		the request is refused rather than allowed to run late.
+//		So is a request that would make a queued one, admitted
+//		earlier, miss its deadline by running ahead of it.  The
+//		check and the queueing are one SPI_LOCK window.  The
+//		estimate relies on TxSize being filled in when the
+//		commands are built.
+//
+//		A control block with a key (see spiSetKey()) that
+//		matches a request already queued, running or delayed is
+//		not queued itself: it joins that request and completes
+//		with its result.
+//
+//		Through spiSched(), without a deadline, the control
+//		block is pushed on the submission list without taking
+//		SPI_LOCK.  Whoever finds the list empty takes the lock
+//		once to move it to the run queue and start an idle bus.
+//		Tasks that submit meanwhile leave their requests to it
+//		while the bus is busy, since the bus takes in the list
+//		between transfers anyway; with the bus idle they take
+//		the lock too, so a high priority task never waits for a
+//		preempted first submitter.
+//
+// Architecture:
+//
+// Relationship: This routine can only be called at task level.
+//
+// Returns: OK, or ERROR with errno ETIMEDOUT if the deadline
+//		cannot be met, or EBUSY if the previous completion of the
+//		control block is still waiting in SpiHdr.Pend.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSchedDeadline(int id, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op,
+	int deadline)
+{
+	return spiSchedCB(id, cmd, ncmds, mode, op, deadline, TRUE);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSchedCB
+//
+// Purpose: schedule a control block.
+//
+// Description: Does the work of spiSched() and spiSchedDeadline();
+//		deadline only counts if due is TRUE.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiSchedDeadline().
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiSchedCB(int id, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op,
+	int deadline, BOOL due)
 {
 	int iv;
+	int late;
+	int prev;
 	SPI_CB *cb;
 
 	SPIDEBUG(("spiSched: id=%d ncmds=%d\n", id, ncmds, 0, 0, 0, 0));
@@ -616,72 +1040,424 @@ spiSched(int id, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op)
 	if ((id < 0) || (id >= SpiMaxCB))
 		return ERROR;
 
-	cb = SpiCB + id;
-	cb->Cmd = cmd;
-	cb->Count = ncmds;
-	cb->Index = 0;
-	cb->Return = 0;
-	cb->Error = 0;
-	cb->Next = 0;
-	cb->State = SPICB_STATE_QUEUE;
-	cb->SyncMode = mode;
-	cb->NotifyOp = (mode != SPI_SYNC) ? op : 0;
-
 	/*
 	// -----------------------------------------------------------
-	// clear any pending condition on control block.
+	// a notification still pended for the daemon refers to this
+	// control block.  DeferPending is read without SPI_LOCK: the
+	// bit is set by this control block's completion and cleared
+	// by the daemon once the call returns, both under the lock.
+	// A caller that has seen the completion did so through the
+	// daemon, a semaphore or the lock, so it sees the bit set; a
+	// bit cleared meanwhile fails the call as if it had come a
+	// moment earlier.
 	// -----------------------------------------------------------
 	*/
 
-	semTake(cb->sem, NO_WAIT);
+	if (SpiHdr.DeferPending & (1 << id)) {
+		errnoSet(EBUSY);
+		return ERROR;
+	}
 
 	/*
 	// -----------------------------------------------------------
-	// acquire exclusive access to spi library routine.
+	// the control block belongs to the caller until it is queued.
 	// -----------------------------------------------------------
 	*/
 
-	semTake(SpiHdr.mutex, WAIT_FOREVER);
+	cb = SpiCB + id;
+	prev = cb->State;
+
+	spiSchedSetup(cb, cmd, ncmds, mode, op, deadline, due);
 
 	/*
 	// -----------------------------------------------------------
-	// disable interrupts.
+	// submit; done unless first of a batch or the bus is idle.
 	// -----------------------------------------------------------
 	*/
 
-	iv = intLock();
-
-	CB_ENQUEUE(&SpiHdr, cb);
+	if (!due) {
 
-	if (SpiHdr.State == SPIDEV_STATE_IDLE) {
+		if ((spiSubmitPush(&SpiHdr, cb, cb) == FALSE) &&
+			(SpiHdr.State != SPIDEV_STATE_IDLE))
+			return OK;
 
-		SpiHdr.State = SPIDEV_STATE_BUSY;
-
-		CB_SCHED(&SpiHdr);
+		spiSubmitKick(&SpiHdr);
 
-		spiStart();
+		return OK;
 	}
 
 	/*
 	// -----------------------------------------------------------
-	// enable interrupts.
+	// with a deadline, admit and queue in one locked window, so
+	// that concurrent submitters are each admitted against the
+	// work of the others.
 	// -----------------------------------------------------------
 	*/
 
-	intUnlock(iv);
+	SPI_LOCK(iv);
 
-	/*
-	// -----------------------------------------------------------
-	// release spi library semaphore.
-	// -----------------------------------------------------------
+	spiSubmitDrain(&SpiHdr);
+
+	late = spiAdmitLate(&SpiHdr, cb->Work, deadline, cb->RunPriority);
+
+	if (late > 0) {
+
+		cb->State = prev;
+
+		SPI_UNLOCK(iv);
+
+		SPIDEBUG(("spiSched: id=%d rejected, late=%d\n", id, late,
+			0, 0, 0, 0));
+
+		errnoSet(ETIMEDOUT);
+		return ERROR;
+	}
+
+	spiSubmitOne(&SpiHdr, cb);
+
+	if ((SpiHdr.State == SPIDEV_STATE_IDLE) && SpiHdr.CBHead) {
+
+		SpiHdr.State = SPIDEV_STATE_BUSY;
+
+		spiSchedNext(&SpiHdr);
+
+		spiStart();
+	}
+
+	SPI_UNLOCK(iv);
+
+	spiDeferFlush();
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSchedv
+//
+// Purpose: schedule several control blocks at once.
+//
+// Description: Same as calling spiSched() for each of the n
+//		requests in turn, but they are submitted as one batch:
+//		they reach the run queue together, in array order, and
+//		the bus is started at most once.  Nothing is scheduled
+//		if any request has an invalid id, the same id as
+//		another, or a completion still waiting in SpiHdr.Pend.
+//
+// Architecture:
+//
+// Relationship: This routine can only be called at task level.
+//
+// Returns: OK, or ERROR if a request is invalid.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSchedv(SPI_SCHED_REQ *req, int n)
+{
+	int i;
+	int j;
+	SPI_CB *cb;
+	SPI_CB *first = 0L;
+	SPI_CB *last = 0L;
+
+	SPIDEBUG(("spiSchedv: n=%d\n", n, 0, 0, 0, 0, 0));
+
+	if (n < 1)
+		return ERROR;
+
+	/*
+	// -----------------------------------------------------------
+	// check the ids, the whole batch is refused if one is bad.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0; i < n; ++i) {
+
+		if ((req[i].Id < 0) || (req[i].Id >= SpiMaxCB))
+			return ERROR;
+
+		/* read without SPI_LOCK, see spiSchedCB() */
+		if (SpiHdr.DeferPending & (1 << req[i].Id)) {
+			errnoSet(EBUSY);
+			return ERROR;
+		}
+
+		for (j = 0; j < i; ++j)
+			if (req[j].Id == req[i].Id)
+				return ERROR;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// set up the control blocks and chain them newest first,
+	// the order of the submission list.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0; i < n; ++i) {
+
+		cb = SpiCB + req[i].Id;
+
+		spiSchedSetup(cb, req[i].Cmd, req[i].Ncmds, req[i].Mode, req[i].Op,
+			0, FALSE);
+
+		cb->Next = first;
+		first = cb;
+
+		if (last == 0L)
+			last = cb;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// submit the chain in one go.
+	// -----------------------------------------------------------
+	*/
+
+	if ((spiSubmitPush(&SpiHdr, first, last) == FALSE) &&
+		(SpiHdr.State != SPIDEV_STATE_IDLE))
+		return OK;
+
+	spiSubmitKick(&SpiHdr);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSchedSetup
+//
+// Purpose: prepare a control block for a new request.
+//
+// Description: Leaves the control block in SPICB_STATE_SUBMIT,
+//		ready for spiSubmitPush().
+//
+// Architecture:
+//
+// Relationship: Called by spiSchedCB() and spiSchedv().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level; the control block is not queued.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiSchedSetup(SPI_CB *cb, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op,
+	int deadline, BOOL due)
+{
+	cb->Cmd = cmd;
+	cb->Count = ncmds;
+	cb->Index = 0;
+	cb->Return = 0;
+	cb->Error = 0;
+	cb->Next = 0;
+	cb->SyncMode = mode;
+	cb->Deadline = deadline;
+	if (due)
+		cb->Flags |= SPICB_FLAG_DEADLINE;
+	else
+		cb->Flags &= ~SPICB_FLAG_DEADLINE;
+	cb->RunPriority = cb->Priority;
+	cb->Work = spiCmdWork(cmd, ncmds);
+	cb->Value = 0;
+	cb->Leader = 0;
+	cb->Join = 0;
+	cb->Joined = 0;
+	cb->NotifyOp = (mode != SPI_SYNC) ? op : 0;
+
+	/*
+	// -----------------------------------------------------------
+	// clear any pending condition on control block.
+	// -----------------------------------------------------------
 	*/
 
-	semGive(SpiHdr.mutex);
+	semTake(cb->sem, NO_WAIT);
+
+	cb->State = SPICB_STATE_SUBMIT;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiAdmit
+//
+// Purpose: admission check for a deadline.
+//
+// Description: Adds the estimated bus time of the given commands
+//		to the work already on the bus: the running control
+//		block plus, under SPI_SCHED_EDF, every queued control
+//		block of higher priority and every one of the same
+//		priority due no later than the deadline, or every queued
+//		control block under the other policies.  Each command
+//		is charged spiWireTime() plus spiCmdOverhead.  The
+//		commands are taken to run at the default priority 0.
+//
+// Architecture:
+//
+// Relationship: Probes a deadline before scheduling;
+//		spiSchedDeadline() runs the same check, through
+//		spiAdmitLate(), as it queues the request.
+//
+// Returns: OK if the work completes by the deadline and keeps
+//		the queued deadlines, otherwise ERROR with errno
+//		ETIMEDOUT.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiAdmit(SPI_CMD *cmd, int ncmds, int deadline)
+{
+	int iv;
+	int late;
+
+	SPI_LOCK(iv);
+
+	spiSubmitDrain(&SpiHdr);
+
+	late = spiAdmitLate(&SpiHdr, spiCmdWork(cmd, ncmds), deadline, 0);
+
+	SPI_UNLOCK(iv);
+
+	if (late > 0) {
+
+		SPIDEBUG(("spiAdmit: rejected, late=%d\n", late, 0, 0, 0, 0, 0));
+
+		errnoSet(ETIMEDOUT);
+		return ERROR;
+	}
 
 	return OK;
 }
 
 
+/*
+// ---------------------------------------------------------------
+// Function: spiAdmitLate
+//
+// Purpose: how late a new request would make a deadline.
+//
+// Description: The new request, of work usec at priority prio, is
+//		checked against its own deadline as by spiAdmitFinish().
+//		A queued control block with a deadline may run after the
+//		new request: one of lower priority, or of the same
+//		priority under SPI_SCHED_EDF if due later, or under
+//		SPI_SCHED_FAIR at all, since another client's turn may
+//		come first.  Each of these is checked again with the new
+//		work added, unless it was going to be late anyway.
+//
+// Architecture:
+//
+// Relationship: Called by spiAdmit() and spiSchedCB().
+//
+// Returns: The most ticks past a deadline at which the work
+//		completes; 0 or less if every deadline is met.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with SPI_LOCK held; the
+//		submission list must have been drained.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiAdmitLate(SPI_HDR *h, int work, int deadline, int prio)
+{
+	int late;
+	int n;
+	SPI_CB *cb;
+
+	late = spiAdmitFinish(h, work, deadline, prio);
+
+	for (cb = h->CBHead; cb; cb = cb->Next) {
+
+		if (!(cb->Flags & SPICB_FLAG_DEADLINE))
+			continue;
+
+		if (!((cb->RunPriority < prio) ||
+			((cb->RunPriority == prio) &&
+			(((h->Policy == SPI_SCHED_EDF) &&
+			((int) (deadline - cb->Deadline) < 0)) ||
+			(h->Policy == SPI_SCHED_FAIR)))))
+			continue;
+
+		n = spiAdmitFinish(h, work, cb->Deadline, cb->RunPriority);
+
+		if ((n > late) &&
+			(spiAdmitFinish(h, 0, cb->Deadline, cb->RunPriority) <= 0))
+			late = n;
+	}
+
+	return late;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiAdmitFinish
+//
+// Purpose: how late a deadline would be met.
+//
+// Description: The work counted is that of spiAdmit(), plus work
+//		usec, for a request due at deadline at priority prio.
+//		Queued control blocks of the same priority due no later
+//		count under SPI_SCHED_EDF, so a queued one is counted in
+//		its own finish.
+//
+// Architecture:
+//
+// Relationship: Called by spiAdmitLate().
+//
+// Returns: Ticks past the deadline at which the work completes;
+//		0 or less if it completes in time.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiAdmitFinish(SPI_HDR *h, int work, int deadline, int prio)
+{
+	int ticks;
+	SPI_CB *cb;
+
+	if (h->RunCB)
+		work += h->RunCB->Work;
+
+	for (cb = h->CBHead; cb; cb = cb->Next)
+		if ((h->Policy != SPI_SCHED_EDF) || (cb->RunPriority > prio) ||
+			((cb->RunPriority == prio) &&
+			(cb->Flags & SPICB_FLAG_DEADLINE) &&
+			((int) (cb->Deadline - deadline) <= 0)))
+			work += cb->Work;
+
+	/*
+	// -----------------------------------------------------------
+	// convert usec to ticks, rounding up.
+	// -----------------------------------------------------------
+	*/
+
+	ticks = (((work + 999) / 1000) * sysClkRateGet() + 999) / 1000;
+
+	return (int) ((int) tickGet() + ticks - deadline);
+}
+
+
 /*
 // ---------------------------------------------------------------
 // Function: spiCancel
@@ -707,7 +1483,8 @@ spiCancel(int id)
 {
 	int iv;
 	SPI_CB *cb;
-	SPI_CB *CBPrev;
+	SPI_CB *prev;
+	SPI_PROF_DECL(t1)
 
 	SPIDEBUG(("spiCancel:id=%d\n", id, 0, 0, 0, 0, 0));
 
@@ -716,21 +1493,16 @@ spiCancel(int id)
 
 	cb = SpiCB + id;
 
-	/*
-	// -----------------------------------------------------------
-	// acquire spi library semaphore.
-	// -----------------------------------------------------------
-	*/
-
-	semTake(SpiHdr.mutex, WAIT_FOREVER);
-
 	/*
 	// -----------------------------------------------------------
 	// disable interrups.
 	// -----------------------------------------------------------
 	*/
 
-	iv = intLock();
+	SPI_LOCK(iv);
+	SPI_PROF_START(t1);
+
+	spiSubmitDrain(&SpiHdr);
 
 	switch (cb->State) {
 
@@ -745,8 +1517,12 @@ spiCancel(int id)
 		// ---------------------------------------------------
 		*/
 
-		if ((cb->Index < cb->Count) && (cb->Cmd+cb->Index)->CsOff)
-			(*(cb->Cmd+cb->Index)->CsOff)(cb);
+		if ((cb->Index < cb->Count) && SPI_OP(cb->Cmd+cb->Index, CsOff))
+			SPI_HOOK(SPI_PROF_CSOFF, (cb->Cmd+cb->Index)->Ops->CsOff, cb);
+
+		spiCsRelease(&SpiHdr);
+
+#ifndef SPI_SPIDEV
 
 		/*
 		// ---------------------------------------------------
@@ -764,6 +1540,8 @@ spiCancel(int id)
 
 		*M360_CPM_CR(M_ADRS) = 0x0751;
 
+#endif	/* SPI_SPIDEV */
+
 		/*
 		// ---------------------------------------------------
 		// mark state of control block
@@ -775,6 +1553,8 @@ spiCancel(int id)
 		cb->Return = ERROR;
 		cb->State = SPICB_STATE_ABORT;
 
+		spiJoinPromote(&SpiHdr, cb);
+
 		/*
 		// ---------------------------------------------------
 		// prepare the semaphore for next time.
@@ -789,7 +1569,7 @@ spiCancel(int id)
 		// ---------------------------------------------------
 		*/
 
-		CB_SCHED(&SpiHdr);
+		spiSchedNext(&SpiHdr);
 
 		if (SpiHdr.RunCB) {
 
@@ -810,24 +1590,31 @@ spiCancel(int id)
 		// ---------------------------------------------------
 		*/
 
-		if (SpiHdr.CBHead == cb) {
+		spiDequeue(&SpiHdr, cb);
 
-			SpiHdr.CBHead = cb->Next;
+		cb->Error = EINTR;
+		cb->Return = -1;
+		cb->State = SPICB_STATE_COMPLETE;
 
-			if (SpiHdr.CBTail == cb)
-				SpiHdr.CBTail = cb->Next;
+		spiJoinPromote(&SpiHdr, cb);
 
-		} else {
+		break;
 
-			for (CBPrev = SpiHdr.CBHead;
-				 CBPrev->Next && CBPrev->Next != cb;
-				 CBPrev = CBPrev->Next) ;
+	case SPICB_STATE_DELAY:
 
-			if (CBPrev->Next == cb)
-				CBPrev->Next = cb->Next;
+		/*
+		// ---------------------------------------------------
+		// remove control block from delay queue.
+		// ---------------------------------------------------
+		*/
 
-			if (SpiHdr.CBTail == cb)
-				SpiHdr.CBTail = CBPrev;
+		if (SpiHdr.DelayCB == cb) {
+			SpiHdr.DelayCB = cb->Next;
+		} else {
+			for (prev = SpiHdr.DelayCB; prev && prev->Next != cb;
+				 prev = prev->Next) ;
+			if (prev)
+				prev->Next = cb->Next;
 		}
 
 		cb->Next = 0;
@@ -835,6 +1622,24 @@ spiCancel(int id)
 		cb->Return = -1;
 		cb->State = SPICB_STATE_COMPLETE;
 
+		spiJoinPromote(&SpiHdr, cb);
+
+		break;
+
+	case SPICB_STATE_JOIN:
+
+		/*
+		// ---------------------------------------------------
+		// leave the request this one has joined.
+		// ---------------------------------------------------
+		*/
+
+		spiJoinRemove(cb);
+
+		cb->Error = EINTR;
+		cb->Return = -1;
+		cb->State = SPICB_STATE_COMPLETE;
+
 		break;
 	}
 
@@ -844,15 +1649,10 @@ spiCancel(int id)
 	// -----------------------------------------------------------
 	*/
 
-	intUnlock(iv);
-
-	/*
-	// -----------------------------------------------------------
-	// release spi library semaphore.
-	// -----------------------------------------------------------
-	*/
+	SPI_PROF_STOP(SPI_PROF_CANCEL, t1);
+	SPI_UNLOCK(iv);
 
-	semGive(SpiHdr.mutex);
+	spiDeferFlush();
 
 	return OK;
 }
@@ -887,20 +1687,1419 @@ spiSync(int id, int timeout)
 
 	semTake(cb->sem, timeout);
 
-	SPIDEBUG(("spiSync exit: \n", 0, 0, 0, 0, 0, 0));
+	SPIDEBUG(("spiSync exit: \n", 0, 0, 0, 0, 0, 0));
+
+	if (cb->Return)
+		printf("SyncError = %d\n", cb->Error);
+
+	return cb->Error;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiError
+//
+// Purpose:
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiError(int id)
+{
+	SPI_CB *cb;
+
+	if ((id < 0) || (id >= SpiMaxCB))
+		return ENOENT;
+
+	cb = SpiCB + id;
+
+	return cb->Error;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSetPolicy
+//
+// Purpose: select the run queue scheduling policy.
+//
+// Description: SPI_SCHED_FIFO runs control blocks in the order
+//		they were queued.  SPI_SCHED_FAIR shares the bus between
+//		the clients set up by spiClientSet() using deficit
+//		round-robin, charging every transfer in bytes or in
+//		estimated wire time (spiFairUnits) so a client cannot
+//		take more than its weighted share by queueing long
+//		command arrays.  SPI_SCHED_EDF runs the control block
+//		with the earliest deadline first (see spiSchedDeadline);
+//		control blocks without a deadline follow in queue order.
+//
+// Architecture:
+//
+// Relationship: This routine can only be called at task level.
+//
+// Returns: OK, or ERROR if the policy is unknown, or if it is
+//		SPI_SCHED_FAIR and spiFairQuantum is not positive.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSetPolicy(int policy)
+{
+	int iv;
+	int i;
+
+	if ((policy != SPI_SCHED_FIFO) && (policy != SPI_SCHED_FAIR) &&
+		(policy != SPI_SCHED_EDF))
+		return ERROR;
+
+	if ((policy == SPI_SCHED_FAIR) && (spiFairQuantum <= 0))
+		return ERROR;
+
+	SPI_LOCK(iv);
+
+	for (i = 0; i < SPI_MAX_CLIENTS; ++i)
+		SpiClient[i].Deficit = 0;
+
+	SpiHdr.Policy = policy;
+	SpiHdr.Client = 0;
+
+	SPI_UNLOCK(iv);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSetPriority
+//
+// Purpose: set the priority of a control block.
+//
+// Description: Whatever the scheduling policy, the run queue is
+//		served highest priority first; the policy only chooses
+//		among control blocks of equal priority.  A running
+//		control block is also preempted at the next command
+//		boundary when one of higher priority is queued, unless
+//		it was made non-preemptible with spiSetPreempt().
+//		Priorities default to 0; larger values run first.  The
+//		priority is taken at spiSched(); a request that others
+//		have joined runs at the highest of theirs, and only that
+//		request does.
+//
+// Architecture:
+//
+// Relationship: Call after spiAllocate() and before spiSched().
+//
+// Returns: OK, or ERROR if the id is invalid.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSetPriority(int id, int priority)
+{
+	if ((id < 0) || (id >= SpiMaxCB))
+		return ERROR;
+
+	SpiCB[id].Priority = priority;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSetPreempt
+//
+// Purpose: allow or forbid preemption of a control block.
+//
+// Description: A control block whose PostOp keeps the bus
+//		(SPICB_STATE_RUN or SPICB_STATE_REPEAT) is normally
+//		parked at its current Index when a higher priority
+//		control block is waiting.  Devices that need the whole
+//		command sequence without another device in between must
+//		disable this.
+//
+// Architecture:
+//
+// Relationship: Call after spiAllocate() and before spiSched().
+//
+// Returns: OK, or ERROR if the id is invalid.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSetPreempt(int id, int enable)
+{
+	if ((id < 0) || (id >= SpiMaxCB))
+		return ERROR;
+
+	if (enable)
+		SpiCB[id].Flags &= ~SPICB_FLAG_NOPREEMPT;
+	else
+		SpiCB[id].Flags |= SPICB_FLAG_NOPREEMPT;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSetBurst
+//
+// Purpose: let a control block keep the bus for several commands.
+//
+// Description: A PostOp that returns SPICB_STATE_QUEUE normally
+//		sends the control block to the back of the run queue
+//		after every command.  With a burst count of N the control
+//		block stays on the bus for up to N commands before it is
+//		requeued, so the scheduling cost is paid once per burst.
+//		A higher priority control block still ends the burst at
+//		the next command boundary, and so does the client
+//		running out of credit under SPI_SCHED_FAIR.  0 or 1
+//		disables bursting.
+//
+// Architecture:
+//
+// Relationship: Call after spiAllocate() and before spiSched().
+//
+// Returns: OK, or ERROR if the id is invalid.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSetBurst(int id, int count)
+{
+	if ((id < 0) || (id >= SpiMaxCB))
+		return ERROR;
+
+	SpiCB[id].Burst = count;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSetKey
+//
+// Purpose: mark a control block as an idempotent read.
+//
+// Description: Requests scheduled with the same non-zero key
+//		while one of them is queued, running or delayed are
+//		coalesced: only the first goes on the bus, the others
+//		wait on it and complete with its Error, Return and
+//		Value, each through its own SyncMode.  The key must
+//		identify the device and the data read completely (see
+//		SPI_KEY()), and the PostOp must leave the result in
+//		cb->Value.  Commands of every joined request must stay
+//		valid until it completes, since a joined request is
+//		run with its own commands if the one it joined is
+//		cancelled.
+//
+// Architecture:
+//
+// Relationship: Call after spiAllocate() and before spiSched().
+//
+// Returns: OK, or ERROR if the id is invalid.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSetKey(int id, int key)
+{
+	if ((id < 0) || (id >= SpiMaxCB))
+		return ERROR;
+
+	SpiCB[id].Key = key;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiClientSet
+//
+// Purpose: bind a task to a fair share client.
+//
+// Description: Control blocks allocated by task tid are charged
+//		to the given client; tasks that are not bound to any
+//		client share client 0.  The weight sets the client's
+//		share of the bus relative to the other clients.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if the client is out of range.
+//
+// Exception:
+//
+// Concurrency: The client is updated with SPI_LOCK held, since
+//		spiFairSelect() reads the weight at interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiClientSet(int client, int tid, int weight)
+{
+	int iv;
+
+	if ((client < 0) || (client >= SPI_MAX_CLIENTS))
+		return ERROR;
+
+	SPI_LOCK(iv);
+
+	SpiClient[client].Tid = tid;
+	SpiClient[client].Weight = (weight > 0) ? weight : 1;
+
+	SPI_UNLOCK(iv);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiWireTime
+//
+// Purpose: estimate the time a transfer occupies the bus.
+//
+// Description: The estimate follows the SPMODE clock settings:
+//		SPICLK is the system clock divided by 16 if DIV16 is set,
+//		and by 4 * (PM + 1); each character is LEN + 1 bits.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: estimated transfer time in microseconds.
+//
+// Exception:
+//
+// Concurrency: Callable from interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiWireTime(int mode, int nbytes)
+{
+	int bits;
+	int div;
+
+	bits = nbytes * (((mode >> 4) & 0x0f) + 1);
+	div = ((mode & 0x0800) ? 16 : 1) * 4 * ((mode & 0x0f) + 1);
+
+	return (bits * div + spiClockMHz - 1) / spiClockMHz;
+}
+
+
+#ifndef SPI_SPIDEV
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCsOn
+//
+// Purpose: assert the chip select for a command.
+//
+// Description: If the previous command left its chip select
+//		asserted and this command addresses the same device
+//		(same chip select routines, identity and spmode) with
+//		SPI_CMD_CSHOLD set, the open chip select window is taken
+//		over and nothing is written.  Otherwise any held chip
+//		select is negated first and the command's CsOn is run.
+//
+// Architecture:
+//
+// Relationship: Called by spiStart() and spiIntr().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiCsOn(SPI_HDR *h, SPI_CB *cb, SPI_CMD *cmd)
+{
+	if (h->HoldCsOff) {
+
+		if ((cmd->Flags & SPI_CMD_CSHOLD) &&
+			(SPI_OP(cmd, CsOn) == h->HoldCsOn) &&
+			(SPI_OP(cmd, CsOff) == h->HoldCsOff) &&
+			(cmd->Cs == h->HoldCs) &&
+			(cmd->Mode == h->HoldMode)) {
+
+			/*
+			// ---------------------------------------------------
+			// same device - stay inside the open window.
+			// ---------------------------------------------------
+			*/
+
+			h->HoldCsOff = 0;
+			h->HoldCB = 0L;
+			return;
+		}
+
+		spiCsRelease(h);
+	}
+
+	if (SPI_OP(cmd, CsOn))
+		SPI_HOOK(SPI_PROF_CSON, cmd->Ops->CsOn, cb);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCsOff
+//
+// Purpose: negate the chip select at the end of a command.
+//
+// Description: A command marked SPI_CMD_CSHOLD leaves its chip
+//		select asserted; the negate routine is remembered in the
+//		device header and run by spiCsOn() or spiCsRelease()
+//		once a command for another device, or no command at
+//		all, follows.
+//
+//		NOTE: a held CsOff routine may run after its control
+//		block has completed, so it must not depend on the
+//		command block contents.
+//
+// Architecture:
+//
+// Relationship: Called by spiIntr().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiCsOff(SPI_HDR *h, SPI_CB *cb, SPI_CMD *cmd)
+{
+	if (SPI_OP(cmd, CsOff) == 0)
+		return;
+
+	if (cmd->Flags & SPI_CMD_CSHOLD) {
+
+		h->HoldCB = cb;
+		h->HoldCsOn = cmd->Ops->CsOn;
+		h->HoldCsOff = cmd->Ops->CsOff;
+		h->HoldCs = cmd->Cs;
+		h->HoldMode = cmd->Mode;
+
+	} else {
+
+		SPI_HOOK(SPI_PROF_CSOFF, cmd->Ops->CsOff, cb);
+	}
+}
+
+#endif	/* SPI_SPIDEV */
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiCsRelease
+//
+// Purpose: negate a chip select held across commands.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiCsRelease(SPI_HDR *h)
+{
+	FUNCPTR CsOff = h->HoldCsOff;
+
+	if (CsOff) {
+
+		h->HoldCsOff = 0;
+
+		SPI_HOOK(SPI_PROF_CSOFF, CsOff, h->HoldCB);
+
+		h->HoldCB = 0L;
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDequeue
+//
+// Purpose: remove a control block from the run queue.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiDequeue(SPI_HDR *h, SPI_CB *cb)
+{
+	SPI_CB *CBPrev;
+
+	if (h->CBHead == cb) {
+
+		h->CBHead = cb->Next;
+
+		if (h->CBTail == cb)
+			h->CBTail = cb->Next;
+
+	} else {
+
+		for (CBPrev = h->CBHead;
+			 CBPrev && CBPrev->Next != cb;
+			 CBPrev = CBPrev->Next) ;
+
+		if (CBPrev) {
+
+			CBPrev->Next = cb->Next;
+
+			if (h->CBTail == cb)
+				h->CBTail = CBPrev;
+		}
+	}
+
+	cb->Next = 0;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDelay
+//
+// Purpose: put a control block on the delay queue.
+//
+// Description: The delay queue timer is kept armed for the
+//		earliest wake-up.
+//
+// Architecture:
+//
+// Relationship: Called by spiIntr() when a PostOp returns
+//		SPICB_STATE_DELAY.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiDelay(SPI_HDR *h, SPI_CB *cb)
+{
+	SPI_CB *p;
+	int now = (int) tickGet();
+
+	cb->Wake = now + ((cb->Delay > 0) ? cb->Delay : 1);
+
+	for (p = h->DelayCB; p; p = p->Next)
+		if ((int) (p->Wake - cb->Wake) <= 0)
+			break;
+
+	if (p == 0L)
+		wdStart(h->wd, cb->Wake - now, (FUNCPTR) spiDelayExpire,
+			(SPI_ARG) h);
+
+	cb->Next = h->DelayCB;
+	h->DelayCB = cb;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiDelayExpire
+//
+// Purpose: return delayed control blocks to the run queue.
+//
+// Description: Control blocks whose delay has expired are queued
+//		again and continue at their current Index; if the bus
+//		is idle it is restarted.  The timer is re-armed for the
+//		next control block still waiting.
+//
+// Architecture:
+//
+// Relationship: Delay queue timer handler.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level (watchdog).
+//
+// ---------------------------------------------------------------
+*/
+void
+spiDelayExpire(SPI_HDR *h)
+{
+	int iv;
+	int now;
+	int next = 0;
+	SPI_CB *cb;
+	SPI_CB **pp;
+
+	SPI_LOCK(iv);
+
+	now = (int) tickGet();
+
+	for (pp = &h->DelayCB; (cb = *pp) != 0L; ) {
+
+		if ((int) (cb->Wake - now) <= 0) {
+
+			*pp = cb->Next;
+
+			cb->State = SPICB_STATE_QUEUE;
+
+			CB_ENQUEUE(h, cb);
+
+		} else {
+
+			if ((next == 0) || ((int) (cb->Wake - now) < next))
+				next = cb->Wake - now;
+
+			pp = &cb->Next;
+		}
+	}
+
+	if (next)
+		wdStart(h->wd, next, (FUNCPTR) spiDelayExpire,
+			(SPI_ARG) h);
+
+	if ((h->State == SPIDEV_STATE_IDLE) && h->CBHead) {
+
+		h->State = SPIDEV_STATE_BUSY;
+
+		spiSchedNext(h);
+
+		spiStart();
+	}
+
+	SPI_UNLOCK(iv);
+
+	spiDeferFlush();
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiJoinFind
+//
+// Purpose: find the request a keyed control block can join.
+//
+// Description: Only requests that have not completed and have
+//		not themselves joined another are candidates.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: The leading control block, or 0L if none.
+//
+// Exception:
+//
+// Concurrency: Interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL SPI_CB *
+spiJoinFind(int key)
+{
+	SPI_CB *cb;
+	int i;
+
+	for (cb = SpiCB, i = 0; i < SpiMaxCB; ++i, ++cb) {
+
+		if (cb->Key != key)
+			continue;
+
+		switch (cb->State) {
+		case SPICB_STATE_QUEUE:
+		case SPICB_STATE_RUN:
+		case SPICB_STATE_REPEAT:
+		case SPICB_STATE_DELAY:
+			return cb;
+		}
+	}
+
+	return 0L;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiJoinRemove
+//
+// Purpose: take a joined control block off its leader.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiJoinRemove(SPI_CB *cb)
+{
+	SPI_CB **pp;
+
+	if (cb->Leader == 0L)
+		return;
+
+	for (pp = &cb->Leader->Join; *pp; pp = &(*pp)->Join) {
+		if (*pp == cb) {
+			*pp = cb->Join;
+			--cb->Leader->Joined;
+			break;
+		}
+	}
+
+	cb->Leader = 0L;
+	cb->Join = 0L;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiJoinPromote
+//
+// Purpose: hand a cancelled request over to its joined requests.
+//
+// Description: The first joined control block is queued with its
+//		own commands and leads the rest.  If the bus is idle it
+//		is restarted.
+//
+// Architecture:
+//
+// Relationship: Called by spiCancel().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiJoinPromote(SPI_HDR *h, SPI_CB *cb)
+{
+	SPI_CB *lead;
+	SPI_CB *p;
+
+	if ((lead = cb->Join) == 0L)
+		return;
+
+	cb->Join = 0L;
+
+	lead->Joined = 0;
+
+	for (p = lead->Join; p; p = p->Join) {
+		p->Leader = lead;
+		++lead->Joined;
+		if (lead->RunPriority < p->RunPriority)
+			lead->RunPriority = p->RunPriority;
+	}
+
+	lead->Leader = 0L;
+	lead->State = SPICB_STATE_QUEUE;
+
+	CB_ENQUEUE(h, lead);
+
+	if (h->State == SPIDEV_STATE_IDLE) {
+
+		h->State = SPIDEV_STATE_BUSY;
+
+		spiSchedNext(h);
+
+		spiStart();
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiJoinFinish
+//
+// Purpose: complete the requests joined to a control block.
+//
+// Description: Joined requests receive the result of the control
+//		block and its final state.  They stay linked through
+//		Join for spiNotify().
+//
+// Architecture:
+//
+// Relationship: Called by spiIntr() for completed or failed
+//		control blocks.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level, under SPI_ISR_LOCK.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiJoinFinish(SPI_CB *cb)
+{
+	SPI_CB *join;
+
+	for (join = cb->Join; join; join = join->Join) {
+		join->Value = cb->Value;
+		join->Error = cb->Error;
+		join->Return = cb->Return;
+		join->State = cb->State;
+		join->Index = join->Count;
+		join->Leader = 0L;
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSubmitPush
+//
+// Purpose: put control blocks on the submission list.
+//
+// Description: Pushes the chain from first to last, linked
+//		through Next newest first.  The list is a stack that is
+//		only ever pushed a chain at a time or taken whole, so a
+//		compare and swap of the head is enough on SMP.  The CPU32 has no compare
+//		and swap; on a uniprocessor interrupts are locked for
+//		the three instructions of the push instead.
+//
+// Architecture:
+//
+// Relationship: Called by spiSchedDeadline().
+//
+// Returns: TRUE if the list was empty, so the caller must take
+//		it in.
+//
+// Exception:
+//
+// Concurrency: Any number of tasks, without SPI_LOCK.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL BOOL
+spiSubmitPush(SPI_HDR *h, SPI_CB *first, SPI_CB *last)
+{
+	SPI_CB *head;
+#ifdef _WRS_CONFIG_SMP
+
+	do {
+		head = h->Submit;
+		last->Next = head;
+	} while (!vxAtomicCas((atomic_t *) &h->Submit, (atomicVal_t) head,
+		(atomicVal_t) first));
+
+#else
+	int iv;
+
+	iv = intLock();
+	head = h->Submit;
+	last->Next = head;
+	h->Submit = first;
+	intUnlock(iv);
+
+#endif
+
+	return (head == 0L);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSubmitDrain
+//
+// Purpose: move the submission list to the run queue.
+//
+// Description: Takes the whole list, restores submission order
+//		and queues each control block, or joins it to an
+//		identical request already queued or in flight (see
+//		spiSetKey()); the leader runs at the higher of the two
+//		priorities.
+//
+// Architecture:
+//
+// Relationship: Called wherever the run queue is examined:
+//		spiSchedNext(), spiXferDone(), spiCancel(), spiAdmit()
+//		and spiSubmitKick().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiSubmitDrain(SPI_HDR *h)
+{
+	SPI_CB *cb;
+	SPI_CB *next;
+	SPI_CB *list;
+
+	if (h->Submit == 0L)
+		return;
+
+	/*
+	// -----------------------------------------------------------
+	// take the list, newest first, and reverse it.
+	// -----------------------------------------------------------
+	*/
+
+#ifdef _WRS_CONFIG_SMP
+	cb = (SPI_CB *) vxAtomicSet((atomic_t *) &h->Submit, 0);
+#else
+	cb = h->Submit;
+	h->Submit = 0L;
+#endif
+
+	for (list = 0L; cb; cb = next) {
+		next = cb->Next;
+		cb->Next = list;
+		list = cb;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// join or queue each control block.
+	// -----------------------------------------------------------
+	*/
+
+	for (cb = list; cb; cb = next) {
+		next = cb->Next;
+		spiSubmitOne(h, cb);
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSubmitOne
+//
+// Purpose: join or queue a submitted control block.
+//
+// Description: A control block with a key joins an identical
+//		request already queued or in flight; the leader runs at
+//		the higher of the two priorities for this request only,
+//		in RunPriority.  Any other control
+//		block goes on the run queue.
+//
+// Architecture:
+//
+// Relationship: Called by spiSubmitDrain() and, for requests with
+//		a deadline, by spiSchedDeadline().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiSubmitOne(SPI_HDR *h, SPI_CB *cb)
+{
+	SPI_CB *leader;
+
+	if (cb->Key && ((leader = spiJoinFind(cb->Key)) != 0L)) {
+
+		cb->State = SPICB_STATE_JOIN;
+		cb->Next = 0L;
+		cb->Leader = leader;
+		cb->Join = leader->Join;
+		leader->Join = cb;
+		++leader->Joined;
+
+		if (leader->RunPriority < cb->RunPriority)
+			leader->RunPriority = cb->RunPriority;
+
+		return;
+	}
+
+	cb->State = SPICB_STATE_QUEUE;
+
+	CB_ENQUEUE(h, cb);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSubmitKick
+//
+// Purpose: take in the submission list and start an idle bus.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: Called by a submitter that found the submission
+//		list empty or the bus idle.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiSubmitKick(SPI_HDR *h)
+{
+	int iv;
+	SPI_PROF_DECL(t0)
+
+	/*
+	// -----------------------------------------------------------
+	// lock the queues.
+	// -----------------------------------------------------------
+	*/
+
+	SPI_LOCK(iv);
+	SPI_PROF_START(t0);
+
+	spiSubmitDrain(h);
+
+	if ((h->State == SPIDEV_STATE_IDLE) && h->CBHead) {
+
+		h->State = SPIDEV_STATE_BUSY;
+
+		spiSchedNext(h);
+
+		spiStart();
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// unlock the queues.
+	// -----------------------------------------------------------
+	*/
+
+	SPI_PROF_STOP(SPI_PROF_SCHED, t0);
+	SPI_UNLOCK(iv);
+
+	spiDeferFlush();
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiNotify
+//
+// Purpose: notify the upper layer that a control block is done.
+//
+// Description: The control block and the requests joined to it
+//		(see spiJoinFinish()) are notified in turn, each
+//		according to its own SyncMode.  An SPI_ASYNC_TASK
+//		completion that does not fit in the deferred call ring
+//		is saved, NotifyOp and Index included, in SpiHdr.Pend,
+//		which the daemon serves after the ring, so none is lost.
+//		While Pend is not empty later completions are queued
+//		there too, so that they are delivered in order.  The
+//		control block cannot be scheduled again until the daemon
+//		has delivered its record, which bounds Pend to one
+//		record per control block.
+//
+// Architecture:
+//
+// Relationship: Called by spiIntr() and the spidev backend after
+//		they have released SPI_ISR_LOCK/SPI_LOCK, so that
+//		notification routines and semaphores are never used
+//		under the spinlock.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiNotify(SPI_CB *cb)
+{
+	int iv;
+	BOOL kick = FALSE;
+	SPI_DEFER *d;
+	SPI_CB *next;
+
+	for (; cb; cb = next) {
+
+		next = cb->Join;
+		cb->Join = 0L;
+
+		switch (cb->SyncMode) {
+		case SPI_SYNC:
+			semGive(cb->sem);
+			break;
+
+		case SPI_ASYNC_ISR:
+			if (cb->NotifyOp)
+				SPI_HOOK(SPI_PROF_NOTIFY, cb->NotifyOp, cb);
+			break;
+
+		case SPI_ASYNC_TASK:
+			if (cb->NotifyOp == 0)
+				break;
+
+			SPI_LOCK(iv);
+
+			if ((SpiHdr.PendTail != SpiHdr.PendHead) ||
+				(spiDeferLocked(cb->NotifyOp, cb->Id, cb->Index) == ERROR)) {
+				d = SpiHdr.Pend + (SpiHdr.PendHead++ % SPI_MAX_CB);
+				d->Function = cb->NotifyOp;
+				d->Arg1 = cb->Id;
+				d->Arg2 = cb->Index;
+				SpiHdr.DeferPending |= 1 << cb->Id;
+				++SpiStat.spiMsgsPended;
+			}
+
+			SPI_UNLOCK(iv);
+
+			kick = TRUE;
+			break;
+		}
+	}
+
+	if (kick)
+		semGive(SpiHdr.defer);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSchedNext
+//
+// Purpose: pick the next control block to run.
+//
+// Description: Moves the control block chosen by the scheduling
+//		policy, among those of the highest queued priority, from
+//		the run queue to h->RunCB, after taking in the
+//		submission list.  h->RunCB is left at 0 if the queue is
+//		empty.
+//
+// Architecture:
+//
+// Relationship: Replaces CB_SCHED for all scheduling points.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiSchedNext(SPI_HDR *h)
+{
+	int prio;
+	SPI_CB *cb;
+
+	spiSubmitDrain(h);
+
+	if (spiTopPriority(h, &prio) == FALSE) {
+		h->RunCB = 0L;
+		return;
+	}
+
+	switch (h->Policy) {
+
+	case SPI_SCHED_FAIR:
+		cb = spiFairSelect(h, prio);
+		break;
+
+	case SPI_SCHED_EDF:
+		cb = spiEdfSelect(h, prio);
+		break;
+
+	default:
+		for (cb = h->CBHead; cb->RunPriority != prio; cb = cb->Next) ;
+		break;
+	}
+
+	if (cb == h->CBHead) {
+		CB_SCHED(h);
+	} else {
+		spiDequeue(h, cb);
+		h->RunCB = cb;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// start a new burst.
+	// -----------------------------------------------------------
+	*/
+
+	cb->BurstLeft = cb->Burst;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiTopPriority
+//
+// Purpose: find the highest priority in the run queue.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: FALSE if the run queue is empty, otherwise TRUE with
+//		the priority stored in *prio.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL BOOL
+spiTopPriority(SPI_HDR *h, int *prio)
+{
+	SPI_CB *cb;
+
+	if ((cb = h->CBHead) == 0L)
+		return FALSE;
+
+	for (*prio = cb->RunPriority; cb; cb = cb->Next)
+		if (cb->RunPriority > *prio)
+			*prio = cb->RunPriority;
+
+	return TRUE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiFairSelect
+//
+// Purpose: deficit round-robin selection between clients.
+//
+// Description: Each client with queued control blocks is visited
+//		in turn and credited spiFairQuantum * Weight on arrival.
+//		It keeps the bus while its credit is positive; spiIntr()
+//		charges every completed transfer against it.  A client
+//		that has nothing queued loses its credit.  If a whole
+//		round finds no client in credit, all waiting clients are
+//		advanced by the number of rounds the closest one needs,
+//		so the time spent here is bounded however large the
+//		transfers are.  Within a client control blocks run in
+//		queue order.  spiSetPolicy() refuses a quantum that is
+//		not positive; one set afterwards counts as 1.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: control block to run; the queue must hold at least
+//		one control block of priority prio.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL SPI_CB *
+spiFairSelect(SPI_HDR *h, int prio)
+{
+	int i;
+	int n;
+	int rounds;
+	int quantum;
+	int unit;
+	SPI_CB *cb;
+	SPI_CLIENT *c;
+	SPI_CB *First[SPI_MAX_CLIENTS];
+
+	unit = (spiFairQuantum > 0) ? spiFairQuantum : 1;
+
+	/*
+	// -----------------------------------------------------------
+	// find the oldest queued control block of every client.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0; i < SPI_MAX_CLIENTS; ++i)
+		First[i] = 0L;
+
+	for (cb = h->CBHead; cb; cb = cb->Next)
+		if ((cb->RunPriority == prio) && (First[cb->Client] == 0L))
+			First[cb->Client] = cb;
+
+	for (;;) {
+
+		/*
+		// -------------------------------------------------------
+		// one round-robin pass.
+		// -------------------------------------------------------
+		*/
+
+		for (i = 0; i < SPI_MAX_CLIENTS; ++i) {
+
+			c = SpiClient + h->Client;
+
+			if (First[h->Client] == 0L)
+				c->Deficit = 0;
+			else if (c->Deficit > 0)
+				return First[h->Client];
+
+			h->Client = (h->Client + 1) % SPI_MAX_CLIENTS;
+
+			c = SpiClient + h->Client;
+			c->Deficit += unit * c->Weight;
+		}
+
+		/*
+		// -------------------------------------------------------
+		// nobody in credit - skip ahead the rounds needed.
+		// -------------------------------------------------------
+		*/
+
+		rounds = -1;
+
+		for (i = 0; i < SPI_MAX_CLIENTS; ++i) {
+
+			if (First[i] == 0L)
+				continue;
+
+			quantum = unit * SpiClient[i].Weight;
+			n = (quantum - SpiClient[i].Deficit) / quantum;
+
+			if ((rounds < 0) || (n < rounds))
+				rounds = n;
+		}
+
+		for (i = 0; i < SPI_MAX_CLIENTS; ++i)
+			if (First[i])
+				SpiClient[i].Deficit +=
+					rounds * unit * SpiClient[i].Weight;
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiEdfSelect
+//
+// Purpose: earliest deadline first selection.
+//
+// Description: Deadlines are tick counts and compared modulo the
+//		tick counter.  Ties and control blocks without a
+//		deadline are taken in queue order.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: control block to run; the queue must hold at least
+//		one control block of priority prio.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with interrupts locked.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL SPI_CB *
+spiEdfSelect(SPI_HDR *h, int prio)
+{
+	SPI_CB *cb;
+	SPI_CB *best;
+
+	for (best = h->CBHead; best->RunPriority != prio; best = best->Next) ;
 
-	if (cb->Return)
-		printf("SyncError = %d\n", cb->Error);
+	for (cb = best->Next; cb; cb = cb->Next)
+		if ((cb->RunPriority == prio) &&
+			(cb->Flags & SPICB_FLAG_DEADLINE) &&
+			(!(best->Flags & SPICB_FLAG_DEADLINE) ||
+			((int) (cb->Deadline - best->Deadline) < 0)))
+			best = cb;
 
-	return cb->Error;
+	return best;
 }
 
 
 /*
 // ---------------------------------------------------------------
-// Function: spiError
+// Function: spiCmdWork
 //
-// Purpose:
+// Purpose: estimate the bus time of a command array.
 //
 // Description:
 //
@@ -908,7 +3107,7 @@ spiSync(int id, int timeout)
 //
 // Relationship:
 //
-// Returns:
+// Returns: estimated time in microseconds.
 //
 // Exception:
 //
@@ -916,17 +3115,15 @@ spiSync(int id, int timeout)
 //
 // ---------------------------------------------------------------
 */
-int
-spiError(int id)
+LOCAL int
+spiCmdWork(SPI_CMD *cmd, int ncmds)
 {
-	SPI_CB *cb;
-
-	if ((id < 0) || (id >= SpiMaxCB))
-		return ENOENT;
+	int work = 0;
 
-	cb = SpiCB + id;
+	for (; ncmds > 0; --ncmds, ++cmd)
+		work += spiWireTime(cmd->Mode, cmd->TxSize) + spiCmdOverhead;
 
-	return cb->Error;
+	return work;
 }
 
 
@@ -953,6 +3150,9 @@ spiError(int id)
 void
 spiStart(void)
 {
+#ifdef SPI_SPIDEV
+	spiSpidevStart();
+#else
 	SCC_BUF *pBd;
 	SPI_CB *cb = SpiHdr.RunCB;
 	SPI_CMD *cmd = cb->Cmd + cb->Index;
@@ -965,8 +3165,7 @@ spiStart(void)
 	// -------------------------------------------------------
 	*/
 
-	if (cmd->CsOn)
-		(*cmd->CsOn)(cb);
+	spiCsOn(&SpiHdr, cb, cmd);
 
 	/*
 	// -------------------------------------------------------
@@ -974,8 +3173,8 @@ spiStart(void)
 	// -------------------------------------------------------
 	*/
 
-	if (cmd->PreOp)
-		cb->State = (*cmd->PreOp)(cb);
+	if (SPI_OP(cmd, PreOp))
+		cb->State = SPI_HOOK(SPI_PROF_PREOP, cmd->Ops->PreOp, cb);
 	else
 		cb->State = SPICB_STATE_QUEUE;
 
@@ -1055,11 +3254,290 @@ spiStart(void)
 	// -------------------------------------------------------
 	*/
 
+	if (spiStartHook)
+		(*spiStartHook)(cb, cmd);
+
 	*M360_CPM_SPCOM(M_ADRS) = 0x80;
 	return;
+#endif	/* SPI_SPIDEV */
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiXferDone
+//
+// Purpose: complete the current command of the running control
+//		block.
+//
+// Description: Negates the chip select, charges the transfer,
+//		runs the PostOp and moves the control block on
+//		according to its new state.  A non-zero error fails the
+//		control block with that error code instead of running
+//		the PostOp.  With more set the next command has already
+//		been transferred together with this one; if the PostOp
+//		advanced to it, the control block keeps the bus and
+//		nothing else happens.
+//
+// Architecture:
+//
+// Relationship: Called by spiIntr() and by the spidev backend.
+//		If the control block gives up the bus the next one is
+//		scheduled; h->RunCB is left at 0 only if the run queue
+//		is empty.  The caller passes the returned control block
+//		to spiNotify() once unlocked.
+//
+// Returns: The control block to notify, or 0.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+SPI_CB *
+spiXferDone(SPI_HDR *h, int error, int more)
+{
+	int n;
+	int t;
+	SPI_CB *cb = h->RunCB;
+	SPI_CB *done = 0L;
+	SPI_CMD *cmd = cb->Cmd + cb->Index;
+
+	/*
+	// -----------------------------------------------------------
+	// negate chip select.
+	// -----------------------------------------------------------
+	*/
+
+#ifndef SPI_SPIDEV
+	spiCsOff(h, cb, cmd);
+#endif
+
+	if (spiDoneHook)
+		(*spiDoneHook)(cb, cmd);
+
+	/*
+	// -----------------------------------------------------------
+	// charge the transfer to the fair share client.
+	// -----------------------------------------------------------
+	*/
+
+	t = spiWireTime(cmd->Mode, cmd->TxSize);
+	n = (spiFairUnits == SPI_FAIR_USEC) ? t : cmd->TxSize;
+
+	SpiClient[cb->Client].Served += n;
+
+	if (h->Policy == SPI_SCHED_FAIR)
+		SpiClient[cb->Client].Deficit -= n;
+
+	/*
+	// -----------------------------------------------------------
+	// account for the work done by the control block.
+	// -----------------------------------------------------------
+	*/
+
+	cb->Work -= t + spiCmdOverhead;
+	if (cb->Work < 0)
+		cb->Work = 0;
+
+	/*
+	// -----------------------------------------------------------
+	// run postprocessing routine.
+	// -----------------------------------------------------------
+	*/
+
+	if (error) {
+		cb->Error = error;
+		cb->Return = ERROR;
+		cb->State = SPICB_STATE_ERROR;
+	} else if (SPI_OP(cmd, PostOp))
+		cb->State = SPI_HOOK(SPI_PROF_POSTOP, cmd->Ops->PostOp, cb);
+	else
+		cb->State = SPICB_STATE_COMPLETE;
+
+	/*
+	// -----------------------------------------------------------
+	// a chained command that advanced stays on the bus: its
+	// successor has already been transferred with it.
+	// -----------------------------------------------------------
+	*/
+
+	if (more && ((cb->State == SPICB_STATE_QUEUE) ||
+		(cb->State == SPICB_STATE_RUN))) {
+		cb->State = SPICB_STATE_RUN;
+		return 0L;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// take in requests submitted during the transfer, so they
+	// count for preemption and bursts.
+	// -----------------------------------------------------------
+	*/
+
+	spiSubmitDrain(h);
+
+	/*
+	// -----------------------------------------------------------
+	// depending on the control block state,
+	// prepare next command.
+	// -----------------------------------------------------------
+	*/
+
+	switch (cb->State) {
+
+	case SPICB_STATE_ERROR:
+
+		/*
+		SPIDEBUG(("spiXferDone: error\n", 0, 0, 0, 0, 0, 0));
+		*/
+
+		/*
+		// -------------------------------------------------------
+		// the current control block has an error,
+		// remove it from the list and get the next
+		// control block in line to run.
+		// -------------------------------------------------------
+		*/
+
+		h->RunCB = 0L;
+
+		spiCsRelease(h);
+
+		/*
+		// -------------------------------------------------------
+		// notify upper layer that command was completed,
+		// once unlocked.
+		// -------------------------------------------------------
+		*/
+
+		spiJoinFinish(cb);
+		done = cb;
+
+		break;
+
+	case SPICB_STATE_QUEUE:
+
+		/*
+		SPIDEBUG(("spiXferDone: ready cb=%x\n", cb, 0, 0, 0, 0, 0));
+		*/
+
+		/*
+		// -------------------------------------------------------
+		// the current control block has completed but
+		// wants to remain in the run queue, place the
+		// current control block at the end of the list
+		// and get the next control block in line to run.
+		// Inside a burst it keeps the bus instead, unless fair
+		// sharing finds its client out of credit.
+		// -------------------------------------------------------
+		*/
+
+		if ((--cb->BurstLeft > 0) &&
+			!((h->Policy == SPI_SCHED_FAIR) &&
+			(SpiClient[cb->Client].Deficit <= 0)) &&
+			!(spiTopPriority(h, &n) && (n > cb->RunPriority))) {
+
+			cb->State = SPICB_STATE_RUN;
+			break;
+		}
+
+		h->RunCB = 0L;
+
+		CB_ENQUEUE(h, cb);
+
+		break;
+
+	case SPICB_STATE_COMPLETE:
+
+		/*
+		SPIDEBUG(("spiXferDone: complete\n", 0, 0, 0, 0, 0, 0));
+		*/
+
+		/*
+		// -------------------------------------------------------
+		// the current control block has completed,
+		// remove it from the list and get the next
+		// control block in line to run.
+		// -------------------------------------------------------
+		*/
+
+		h->RunCB = 0L;
+
+		/*
+		// -------------------------------------------------------
+		// notify higher level that command was completed,
+		// once unlocked.
+		// -------------------------------------------------------
+		*/
+
+		spiJoinFinish(cb);
+		done = cb;
+
+		break;
+
+	case SPICB_STATE_DELAY:
+
+		/*
+		// -------------------------------------------------------
+		// the current control block wants to continue
+		// after cb->Delay ticks, give up the bus until
+		// then.
+		// -------------------------------------------------------
+		*/
+
+		h->RunCB = 0L;
+
+		spiDelay(h, cb);
+
+		break;
+
+	case SPICB_STATE_REPEAT:
+	case SPICB_STATE_RUN:
+
+		/*
+		SPIDEBUG(("spiXferDone: repeat\n", 0, 0, 0, 0, 0, 0));
+		*/
+
+		/*
+		// -------------------------------------------------------
+		// the current control block wants to run again
+		// -- leave the control block on the run queue,
+		// unless a higher priority control block is
+		// waiting: then park it at its current command
+		// in front of the queue.
+		// -------------------------------------------------------
+		*/
+
+		if (!(cb->Flags & SPICB_FLAG_NOPREEMPT) &&
+			spiTopPriority(h, &n) && (n > cb->RunPriority)) {
+
+			h->RunCB = 0L;
+
+			cb->State = SPICB_STATE_QUEUE;
+
+			CB_PUSH(h, cb);
+		}
+
+		break;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// the bus was given up, schedule the next control block.
+	// -----------------------------------------------------------
+	*/
+
+	if (h->RunCB == 0L)
+		spiSchedNext(h);
+
+	return done;
 }
 
 
+#ifndef SPI_SPIDEV
+
 /*
 // ---------------------------------------------------------------
 // Function: spiIntr
@@ -1085,8 +3563,20 @@ spiIntr(SPI_HDR *h)
 {
 	int spie;
 	SPI_CB *cb;
+	SPI_CB *done = 0L;
 	SPI_CMD *cmd;
 	SCC_BUF *pBd;
+	SPI_PROF_DECL(t0)
+
+	SPI_PROF_START(t0);
+
+	/*
+	// -----------------------------------------------------------
+	// lock out spiSched()/spiCancel() on other processors.
+	// -----------------------------------------------------------
+	*/
+
+	SPI_ISR_LOCK();
 
 	/*
 	// -----------------------------------------------------------
@@ -1145,25 +3635,12 @@ spiIntr(SPI_HDR *h)
 
 			/*
 			// ---------------------------------------------------
-			// notify upper layer.
+			// notify upper layer once unlocked.
 			// ---------------------------------------------------
 			*/
 
-			switch (cb->SyncMode) {
-			case SPI_SYNC:
-				semGive(cb->sem);
-				break;
-
-			case SPI_ASYNC_ISR:
-				if (cb->NotifyOp)
-					(*cb->NotifyOp)(cb);
-				break;
-
-			case SPI_ASYNC_TASK:
-				if (cb->NotifyOp)
-					spiDefer(cb->NotifyOp, cb->Id, cb->Index);
-				break;
-			}
+			spiJoinFinish(cb);
+			done = cb;
 		}
 	}
 #endif
@@ -1188,159 +3665,8 @@ spiIntr(SPI_HDR *h)
 		// -------------------------------------------------------
 		*/
 
-		if (h->RunCB) {
-
-			cb = h->RunCB;
-
-			cmd = cb->Cmd + cb->Index;
-
-			/*
-			// ---------------------------------------------------
-			// negate chip select.
-			// ---------------------------------------------------
-			*/
-
-			if (cmd->CsOff)
-				(*cmd->CsOff)(cb);
-
-			/*
-			// ---------------------------------------------------
-			// run postprocessing routine.
-			// ---------------------------------------------------
-			*/
-
-			if (cmd->PostOp)
-				cb->State = (*cmd->PostOp)(cb);
-			else
-				cb->State = SPICB_STATE_COMPLETE;
-
-			/*
-			// ---------------------------------------------------
-			// depending on the control block state,
-			// prepare next command.
-			// ---------------------------------------------------
-			*/
-
-			switch (cb->State) {
-
-			case SPICB_STATE_ERROR:
-
-				/*
-				SPIDEBUG(("spiIntr: error\n", 0, 0, 0, 0, 0, 0));
-				*/
-
-				/*
-				// -----------------------------------------------
-				// the current control block has an error,
-				// remove it from the list and get the next
-				// control block in line to run.
-				// -----------------------------------------------
-				*/
-
-				h->RunCB = 0L;
-
-				/*
-				// -----------------------------------------------
-				// notify upper layer that command was completed.
-				// -----------------------------------------------
-				*/
-
-				switch (cb->SyncMode) {
-				case SPI_SYNC:
-					semGive(cb->sem);
-					break;
-
-				case SPI_ASYNC_ISR:
-					if (cb->NotifyOp)
-						(*cb->NotifyOp)(cb);
-					break;
-
-				case SPI_ASYNC_TASK:
-					if (cb->NotifyOp)
-						spiDefer(cb->NotifyOp, cb->Id, cb->Index);
-					break;
-				}
-
-				break;
-
-			case SPICB_STATE_QUEUE:
-
-				/*
-				SPIDEBUG(("spiIntr: ready cb=%x\n", cb, 0, 0, 0, 0, 0));
-				*/
-
-				/*
-				// -----------------------------------------------
-				// the current control block has completed but
-				// wants to remain in the run queue, place the
-				// current control block at the end of the list
-				// and get the next control block in line to run.
-				// -----------------------------------------------
-				*/
-
-				h->RunCB = 0L;
-
-				CB_ENQUEUE(h, cb);
-
-				break;
-
-			case SPICB_STATE_COMPLETE:
-
-				/*
-				SPIDEBUG(("spiIntr: complete\n", 0, 0, 0, 0, 0, 0));
-				*/
-
-				/*
-				// -----------------------------------------------
-				// the current control block has completed,
-				// remove it from the list and get the next
-				// control block in line to run.
-				// -----------------------------------------------
-				*/
-
-				h->RunCB = 0L;
-
-				/*
-				// -----------------------------------------------
-				// notify higher level that command was completed.
-				// -----------------------------------------------
-				*/
-
-				switch (cb->SyncMode) {
-				case SPI_SYNC:
-					semGive(cb->sem);
-					break;
-
-				case SPI_ASYNC_ISR:
-					if (cb->NotifyOp)
-						(*cb->NotifyOp)(cb);
-					break;
-
-				case SPI_ASYNC_TASK:
-					if (cb->NotifyOp)
-						spiDefer(cb->NotifyOp, cb->Id, cb->Index);
-					break;
-				}
-
-				break;
-
-			case SPICB_STATE_REPEAT:
-			case SPICB_STATE_RUN:
-
-				/*
-				SPIDEBUG(("spiIntr: repeat\n", 0, 0, 0, 0, 0, 0));
-				*/
-
-				/*
-				// -----------------------------------------------
-				// the current control block wants to run again
-				// -- leave the control block on the run queue.
-				// -----------------------------------------------
-				*/
-
-				break;
-			}
-		}
+		if (h->RunCB)
+			done = spiXferDone(h, 0, FALSE);
 	}
 
 	/*
@@ -1351,7 +3677,7 @@ spiIntr(SPI_HDR *h)
 
 	if (h->RunCB == 0) {
 
-		CB_SCHED(h);
+		spiSchedNext(h);
 
 		/*
 		SPIDEBUG(("spiIntr: sched h=%x h->RunCB=%x\n",
@@ -1371,6 +3697,8 @@ spiIntr(SPI_HDR *h)
 		SPIDEBUG(("spiIntr: idle\n", 0, 0, 0, 0, 0, 0));
 		*/
 
+		spiCsRelease(h);
+
 		SpiHdr.State = SPIDEV_STATE_IDLE;
 
 	} else {
@@ -1391,8 +3719,7 @@ spiIntr(SPI_HDR *h)
 		// -------------------------------------------------------
 		*/
 
-		if (cmd->CsOn)
-			(*cmd->CsOn)(cb);
+		spiCsOn(h, cb, cmd);
 
 		/*
 		// -------------------------------------------------------
@@ -1400,8 +3727,8 @@ spiIntr(SPI_HDR *h)
 		// -------------------------------------------------------
 		*/
 
-		if (cmd->PreOp)
-			cb->State = (*cmd->PreOp)(cb);
+		if (SPI_OP(cmd, PreOp))
+			cb->State = SPI_HOOK(SPI_PROF_PREOP, cmd->Ops->PreOp, cb);
 		else
 			cb->State = SPICB_STATE_QUEUE;
 
@@ -1469,10 +3796,24 @@ spiIntr(SPI_HDR *h)
 		// -------------------------------------------------------
 		*/
 
+		if (spiStartHook)
+			(*spiStartHook)(cb, cmd);
+
 		*M360_CPM_SPCOM(M_ADRS) = 0x80;
 	}
 
+	SPI_ISR_UNLOCK();
+
+	spiDeferFlush();
+
+	if (done)
+		spiNotify(done);
+
 	*M360_CPM_CISR(M_ADRS) |= CPIC_CIXR_SPI;
 
+	SPI_PROF_STOP(SPI_PROF_ISR, t0);
+
 	return;
 }
+
+#endif	/* SPI_SPIDEV */
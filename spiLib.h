@@ -18,13 +18,21 @@
 #ifndef	SPILIB_H
 #define	SPILIB_H
 
-#include "VxWorks.h"
+#include "vxWorks.h"
 #include "semLib.h"
 #include "ioLib.h"
 #include "taskLib.h"
 #include "msgQLib.h"
+#include "wdLib.h"
 #include "iosLib.h"
 #include "errno.h"
+#ifdef _WRS_CONFIG_SMP
+#include "spinLockLib.h"
+#include "vxAtomicLib.h"
+#endif
+#ifdef SPI_PROFILE
+#include "spiProf.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,6 +63,18 @@ extern "C" {
 #define SPICB_STATE_RUN			5	/* command is running */
 #define SPICB_STATE_DELAY		6	/* delay command */
 #define SPICB_STATE_ABORT		7	/* cancelled command */
+#define SPICB_STATE_JOIN		8	/* waiting on an identical request */
+#define SPICB_STATE_ALLOC		9	/* allocated, not scheduled yet */
+#define SPICB_STATE_SUBMIT		10	/* on the submission list */
+
+/*
+// ---------------------------------------------------------------
+// SPI control block flags.
+// ---------------------------------------------------------------
+*/
+
+#define SPICB_FLAG_NOPREEMPT	0x01	/* keep the bus for whole sequence */
+#define SPICB_FLAG_DEADLINE		0x02	/* request has a Deadline */
 
 /*
 // ---------------------------------------------------------------
@@ -66,6 +86,19 @@ extern "C" {
 #define SPI_ASYNC_ISR			1	/* asynchronous isr notification */
 #define SPI_ASYNC_TASK			2	/* asynchronous task notification */
 
+/*
+// ---------------------------------------------------------------
+// SPI run queue scheduling policies.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_SCHED_FIFO			0	/* first come, first served */
+#define SPI_SCHED_FAIR			1	/* deficit round-robin by client */
+#define SPI_SCHED_EDF			2	/* earliest deadline first */
+
+#define SPI_FAIR_BYTES			0	/* fair share accounted in bytes */
+#define SPI_FAIR_USEC			1	/* fair share accounted in usec */
+
 /*
 // ---------------------------------------------------------------
 // SPI interrupt events.
@@ -76,32 +109,115 @@ extern "C" {
 #define SPI_EVENT_BSY    	0x04    /* spi event Busy condition  */
 #define SPI_EVENT_RXB    	0x01    /* spi event Buffer received */
 
+/*
+// ---------------------------------------------------------------
+// SPI command flags.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_CMD_CSHOLD			0x01	/* chip select may stay asserted */
+#define SPI_CMD_CHAIN			0x02	/* may share a transfer with the next */
+
+/*
+// SPI_CMD_CHAIN promises that the PostOp only advances to the next
+// command and that the next PreOp does not depend on the data
+// received, so a backend may submit both transfers together.
+*/
+
 /*
 // ---------------------------------------------------------------
 // SPI miscellanous defintions.
 // ---------------------------------------------------------------
 */
 
-#define SPI_MAX_ARGS     		6
-#define SPI_MAX_MSGS     		10
+#define SPI_MAX_ARGS     		3
+#define SPI_MAX_DEFER     		16	/* completion ring, power of 2 */
 #define SPI_MAX_CB				10
+#define SPI_MAX_CLIENTS			8
 #define SPI_BUFFER_SIZE			1024
 
 #define SPIDEBUG(x)				{ if (spiDebug) logMsg x ; }
 
+/*
+// With SPI_PROFILE, SPI_PROF_START/STOP time a section in a local
+// declared with SPI_PROF_DECL, SPI_LOCK windows are timed, and
+// SPI_HOOK calls a device hook through the profiler (spiProf.h).
+*/
+
+#ifdef SPI_PROFILE
+#define SPI_PROF_DECL(t)		UINT32 t;
+#define SPI_PROF_START(t)		{ (t) = spiProfStamp(); }
+#define SPI_PROF_STOP(sec, t)	{ spiProfRecord((sec), (t)); }
+#define SPI_PROF_LOCKED()		spiProfLockTake()
+#define SPI_PROF_UNLOCKING()	spiProfLockGive()
+#define SPI_HOOK(kind, fn, cb)	spiProfCall((kind), (fn), (cb))
+#else
+#define SPI_PROF_DECL(t)
+#define SPI_PROF_START(t)
+#define SPI_PROF_STOP(sec, t)
+#define SPI_PROF_LOCKED()
+#define SPI_PROF_UNLOCKING()
+#define SPI_HOOK(kind, fn, cb)	(*(fn))(cb)
+#endif
+
+/*
+// SPI_LOCK/SPI_UNLOCK protect the run, delay and join queues and
+// the control block states at task and interrupt level.  On a
+// uniprocessor they lock interrupts; on SMP they take spiLock,
+// an ISR-safe spinlock that also locks interrupts on the local
+// CPU.  spiIntr() runs under SPI_ISR_LOCK, which is only needed
+// on SMP.  SPI_BARRIER_R/W/RW order memory accesses for the
+// lock-free readers (deferred call ring, sample snapshot) on SMP.
+// The submission list (SpiHdr.Submit) is pushed without either
+// lock, see spiSubmitPush().  No semaphore is given and no
+// notification routine is called under either lock: code that
+// runs under it records the call with spiDeferLocked() or
+// spiDeferIsrLocked() and the lock holder delivers it with
+// spiDeferFlush().
+*/
+
+#ifdef _WRS_CONFIG_SMP
+#define SPI_LOCK(iv)			{ (iv) = 0; spinLockIsrTake(&spiLock); \
+								  SPI_PROF_LOCKED(); }
+#define SPI_UNLOCK(iv)			{ (void) (iv); SPI_PROF_UNLOCKING(); \
+								  spinLockIsrGive(&spiLock); }
+#define SPI_ISR_LOCK()			spinLockIsrTake(&spiLock)
+#define SPI_ISR_UNLOCK()		spinLockIsrGive(&spiLock)
+#define SPI_BARRIER_R()			VX_MEM_BARRIER_R()
+#define SPI_BARRIER_W()			VX_MEM_BARRIER_W()
+#define SPI_BARRIER_RW()		VX_MEM_BARRIER_RW()
+#else
+#define SPI_LOCK(iv)			{ (iv) = intLock(); SPI_PROF_LOCKED(); }
+#define SPI_UNLOCK(iv)			{ SPI_PROF_UNLOCKING(); intUnlock(iv); }
+#define SPI_ISR_LOCK()
+#define SPI_ISR_UNLOCK()
+#define SPI_BARRIER_R()
+#define SPI_BARRIER_W()
+#define SPI_BARRIER_RW()
+#endif
+
+/* single-flight key for spiSetKey(), never 0 for a valid device */
+#define SPI_KEY(dev, cs, ch)	((((dev) & 0xff) << 24) | \
+								 (((cs) & 0xff) << 16) | ((ch) & 0xffff))
+
+/*
+// Command arguments hold ints and pointers alike, so a slot is a
+// long: as wide as a pointer on the ILP32 target and on LP64
+// hosts.  Store a pointer as (SPI_ARG) p and read it back with a
+// cast to its own type.  Task and watchdog arguments are passed
+// the same way.
+*/
+
 #define SPI_ARG_PARM0	Arg[0]
 #define SPI_ARG_PARM1	Arg[1]
 #define SPI_ARG_PARM2	Arg[2]
-#define SPI_ARG_PARM3	Arg[3]
-#define SPI_ARG_PARM4	Arg[4]
-#define SPI_ARG_PARM5	Arg[5]
 
 #define SPI_ARG_TEMP0	Arg[0]
 #define SPI_ARG_TEMP1	Arg[1]
 #define SPI_ARG_TEMP2	Arg[2]
-#define SPI_ARG_TEMP3	Arg[3]
-#define SPI_ARG_TEMP4	Arg[4]
-#define SPI_ARG_TEMP5	Arg[5]
+
+/* device hook of a command, 0 if none */
+#define SPI_OP(cmd, op)	((cmd)->Ops ? (cmd)->Ops->op : (FUNCPTR) 0)
 
 
 /*
@@ -110,64 +226,133 @@ extern "C" {
 // ---------------------------------------------------------------
 */
 
-/* spi internal message structure */
+/* command, task or watchdog argument, int or pointer */
+typedef long SPI_ARG;
+
+/* spi deferred call record */
 typedef struct {
 	FUNCPTR Function;
-	int Arg[SPI_MAX_ARGS];
-} SPI_MSG;
+	int Arg1;
+	int Arg2;
+} SPI_DEFER;
 
 /* spi statistics block structure */
 typedef struct {
 	int spiMsgsLost;	/* message lost counter */
 	int oldMsgsLost;
 	int newMsgsLost;
+	int spiMsgsPended;	/* completions passed through SpiHdr.Pend */
 } SPI_STAT;
 
+/* spi fair share client structure */
+typedef struct {
+	int Tid;			/* task bound to client, 0 if none */
+	int Weight;			/* share of the bus relative to others */
+	int Deficit;		/* deficit round-robin credit */
+	int Served;			/* bus time consumed, in fair units */
+} SPI_CLIENT;
+
+/*
+// The device hooks live in an SPI_OPS table shared by all commands
+// to the device, so a command holds only what changes from one
+// command to the next.  SPI_CB starts with the fields spiIntr()
+// uses on every transfer, then those used when a control block
+// completes; the rest is set up by the scheduling calls.
+*/
+
+/* spi device hooks */
+typedef struct {
+	FUNCPTR CsOn;		/* chip select on - interrupt time */
+	FUNCPTR CsOff;		/* chip select off - interrupt time */
+	FUNCPTR PreOp;		/* preprocessing - interrupt time */
+	FUNCPTR PostOp;		/* postprocessing - interrupt time */
+} SPI_OPS;
+
 /* spi command block structure */
 typedef struct {
-	int Mode;
-	int TxSize;
-	int RxSize;
+	const SPI_OPS *Ops;	/* device hooks, 0 if none */
 	char *TxBuf;
 	char *RxBuf;
-	int Arg[SPI_MAX_ARGS];
-	FUNCPTR CsOff;		/* chip select off - interrupt time */
-	FUNCPTR CsOn;		/* chip select on - interrupt time */
-	FUNCPTR PostOp;		/* postprocessing - interrupt time */
-	FUNCPTR PreOp;		/* preprocessing - interrupt time */
+	UINT16 Mode;		/* spmode */
+	UINT16 TxSize;
+	UINT16 RxSize;
+	UINT8 Flags;		/* command flags */
+	UINT8 Cs;			/* chip select identity */
+	SPI_ARG Arg[SPI_MAX_ARGS];
 } SPI_CMD;
 
+/* spi request for spiSchedv() */
+typedef struct {
+	int Id;				/* control block */
+	SPI_CMD *Cmd;
+	int Ncmds;
+	int Mode;			/* SPI_SYNC, SPI_ASYNC_ISR or SPI_ASYNC_TASK */
+	FUNCPTR Op;			/* notification operation */
+} SPI_SCHED_REQ;
+
 /* spi control block structure */
 struct SPI_CB {
-	int Id;
-	int State;
+	SPI_CMD *Cmd;		/* -- per transfer -- */
 	int Index;
-	int Return;
-	int Error;
-	int Priority;
 	int Count;
+	int State;
+	int Flags;			/* control block flags */
+	int Priority;		/* larger runs first, default 0 */
+	int RunPriority;	/* Priority of this request, raised by joins */
+	int BurstLeft;		/* commands left in the current turn */
+	int Client;			/* fair share client */
+	int Work;			/* estimated bus time remaining in usec */
+	struct SPI_CB *Next;
+	int Return;			/* -- per completion -- */
+	int Error;
+	int Burst;			/* commands per turn on the bus */
 	int SyncMode;
 	FUNCPTR NotifyOp;	/* notification operation - isr/task time */
 	SEM_ID sem;
-	struct SPI_CB *Next;
-	SPI_CMD *Cmd;
+	struct SPI_CB *Join;	/* joined requests, linked through Join */
+	int Joined;			/* requests that joined this one */
+	int Value;			/* result shared with joined requests */
+	int Id;				/* -- scheduling calls -- */
+	int Key;			/* single-flight request key, 0 if none */
+	struct SPI_CB *Leader;	/* request this one has joined */
+	int Deadline;		/* absolute deadline in ticks, see Flags */
+	int Delay;			/* ticks to wait for SPICB_STATE_DELAY */
+	int Wake;			/* tick count to leave the delay queue */
 };
 typedef struct SPI_CB SPI_CB;
 
 /* spi device header structure */
 typedef struct {
-	MSG_Q_ID mq;		/* daemon message queue id */
+	SEM_ID defer;		/* daemon wake-up */
 	int tid;			/* daemon task id */
+	SPI_DEFER Defer[SPI_MAX_DEFER];	/* deferred call ring */
+	volatile unsigned int DeferHead;	/* records added, interrupt level */
+	volatile unsigned int DeferTail;	/* records taken, daemon */
+	SPI_DEFER Pend[SPI_MAX_CB];	/* completions past a full ring, in order */
+	unsigned int PendHead;	/* records added, under SPI_LOCK */
+	unsigned int PendTail;	/* records delivered, under SPI_LOCK */
+	volatile int DeferPending;	/* control blocks with a record in Pend */
+	volatile int DeferKick;	/* ring records added since the last wake */
+	SPI_DEFER Late[SPI_MAX_DEFER];	/* calls to make after the unlock */
+	volatile int NLate;	/* records in Late, under SPI_LOCK */
 	int State;			/* device state mask */
 	int IsStalled;		/* interrupt routine stalled */
 	int StalledIndex;	/* which command block stalled */
 	int LastTick;		/* tick count for timeout mechanism */
 	int Interval;		/* tick interval for timeout mechansim */
+	int Policy;			/* run queue scheduling policy */
+	int Client;			/* fair share round-robin position */
+	SPI_CB * volatile Submit;	/* submitted, newest first */
 	SPI_CB *CBHead;		/* head of control block link list */
 	SPI_CB *CBTail;		/* tail of control block link list */
 	SPI_CB *RunCB;		/* run queue */
 	SPI_CB *DelayCB;	/* delay queue */
-	SEM_ID mutex;		/* mutual exclusion semaphore */
+	WDOG_ID wd;			/* delay queue timer */
+	SPI_CB *HoldCB;		/* control block holding chip select */
+	FUNCPTR HoldCsOn;	/* held chip select - assert routine */
+	FUNCPTR HoldCsOff;	/* held chip select - negate routine */
+	int HoldCs;			/* held chip select identity */
+	int HoldMode;		/* held chip select spmode */
 } SPI_HDR;
 
 
@@ -187,20 +372,49 @@ extern int spiPriority;
 extern int spiStackSize;
 extern int spiMsgTimeout;
 extern int spiWdgTimeout;
+extern int spiClockMHz;
+extern int spiCmdOverhead;
+extern int spiFairUnits;
+extern int spiFairQuantum;
+extern FUNCPTR spiStartHook;
+extern FUNCPTR spiDoneHook;
+extern FUNCPTR spiValueHook;
 extern SPI_CB SpiCB[];
+extern SPI_CLIENT SpiClient[];
 extern SPI_HDR SpiHdr;
 extern SPI_STAT SpiStat;
+#ifdef _WRS_CONFIG_SMP
+extern spinlockIsr_t spiLock;
+#endif
 
+extern int spiAdmit(SPI_CMD *cmd, int ncmds, int deadline);
 extern int spiAllocate(void);
 extern int spiCancel(int id);
+extern int spiClientSet(int client, int tid, int weight);
+extern int spiDefer(FUNCPTR Function, int Arg1, int Arg2);
+extern void spiDeferFlush(void);
+extern int spiDeferIsrLocked(FUNCPTR Function, int Arg1, int Arg2);
+extern int spiDeferLocked(FUNCPTR Function, int Arg1, int Arg2);
 extern int spiError(int id);
 extern int spiFree(int id);
 extern int spiInit(void);
 extern int spiSched(int id, SPI_CMD *cmd, int ncmds, int mode, FUNCPTR op);
+extern int spiSchedDeadline(int id, SPI_CMD *cmd, int ncmds, int mode,
+	FUNCPTR op, int deadline);
+extern int spiSchedv(SPI_SCHED_REQ *req, int n);
+extern int spiSetBurst(int id, int count);
+extern int spiSetKey(int id, int key);
+extern int spiSetPolicy(int policy);
+extern int spiSetPreempt(int id, int enable);
+extern int spiSetPriority(int id, int priority);
 extern int spiSync(int id, int timeout);
+extern int spiWireTime(int mode, int nbytes);
 extern void spiDaemon();
+extern void spiDelayExpire(SPI_HDR *h);
 extern void spiIntr(SPI_HDR *h);
+extern void spiNotify(SPI_CB *cb);
 extern void spiStart(void);
+extern SPI_CB *spiXferDone(SPI_HDR *h, int error, int more);
 #else
 extern char spiRxBuffer[];
 extern char spiTxBuffer[];
@@ -211,20 +425,48 @@ extern int spiPriority;
 extern int spiStackSize;
 extern int spiMsgTimeout;
 extern int spiWdgTimeout;
+extern int spiClockMHz;
+extern int spiCmdOverhead;
+extern int spiFairUnits;
+extern int spiFairQuantum;
+extern FUNCPTR spiStartHook;
+extern FUNCPTR spiDoneHook;
+extern FUNCPTR spiValueHook;
 extern SPI_CB SpiCB[];
+extern SPI_CLIENT SpiClient[];
 extern SPI_HDR SpiHdr;
 extern SPI_STAT SpiStat;
+#ifdef _WRS_CONFIG_SMP
+extern spinlockIsr_t spiLock;
+#endif
 
+extern int spiAdmit();
 extern int spiAllocate();
 extern int spiCancel();
+extern int spiClientSet();
+extern int spiDefer();
+extern void spiDeferFlush();
+extern int spiDeferIsrLocked();
+extern int spiDeferLocked();
 extern int spiError();
 extern int spiFree();
 extern int spiInit();
 extern int spiSched();
+extern int spiSchedDeadline();
+extern int spiSchedv();
+extern int spiSetBurst();
+extern int spiSetKey();
+extern int spiSetPolicy();
+extern int spiSetPreempt();
+extern int spiSetPriority();
 extern int spiSync();
+extern int spiWireTime();
 extern void spiDaemon();
+extern void spiDelayExpire();
 extern void spiIntr();
+extern void spiNotify();
 extern void spiStart();
+extern SPI_CB *spiXferDone();
 #endif	/* __STDC__ */
 
 
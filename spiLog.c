@@ -0,0 +1,890 @@
+/*
+// ---------------------------------------------------------------
+// File: spiLog.c
+//
+// Module: SPI sample logger.
+//
+// Description: Writes the values read from the LTC1598 and the
+//		temperature sensor, with their ticks and channels, to an
+//		append-only binary file for long acquisition runs, and
+//		reads them back by time.
+//
+// Operation: spiLogStart() creates the file with the channels to
+//		log and installs spiLogPut() as the spiLib value hook,
+//		which the device read PostOps call with the SPI_KEY and
+//		value of every conversion.  A sample of a channel not in
+//		the file is ignored.  Each logged sample is coded into
+//		the block being filled as a channel index and the tick
+//		and value deltas in variable length, typically 3 or 4
+//		bytes; when the next record might not fit, the block is
+//		closed and a new one started.  The format is described
+//		in spiLog.h.
+//
+//		On the target the blocks are filled in a ring of
+//		SPI_LOG_RING blocks in memory and the tSpiLog task
+//		writes them out on the tick after they are closed;
+//		samples are lost if the writer falls a whole ring
+//		behind.  Linux builds (SPI_SPIDEV) instead size the
+//		file for the given number of blocks and map it, so the
+//		blocks are filled in place and logging needs no system
+//		calls at all; when the file is full further samples are
+//		lost.  spiLogStop() cuts the file after the last block
+//		used.
+//
+//		Either way a sample costs a channel lookup and at most
+//		SPI_LOG_REC_MAX byte stores, at interrupt level, plus a
+//		block close every few hundred samples.  Ticks come from
+//		tickGet().
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "ioLib.h"
+#include "intLib.h"
+#include "taskLib.h"
+#include "tickLib.h"
+#include "sysLib.h"
+#include "spiLib.h"
+#include "spiLog.h"
+
+#if defined(SPI_SPIDEV) && !defined(SPI_LOG_NO_MMAP)
+#define SPI_LOG_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define LOG_PUT16(p, v)	{ \
+	(p)[0] = (UINT8) ((v) >> 8); \
+	(p)[1] = (UINT8) (v); \
+}
+
+#define LOG_PUT32(p, v)	{ \
+	(p)[0] = (UINT8) ((v) >> 24); \
+	(p)[1] = (UINT8) ((v) >> 16); \
+	(p)[2] = (UINT8) ((v) >> 8); \
+	(p)[3] = (UINT8) (v); \
+}
+
+#define LOG_GET16(p)	((((UINT32) (p)[0]) << 8) | (p)[1])
+
+#define LOG_GET32(p)	((((UINT32) (p)[0]) << 24) | \
+	(((UINT32) (p)[1]) << 16) | (((UINT32) (p)[2]) << 8) | (p)[3])
+
+#define LOG_ZIGZAG(v)	((((UINT32) (v)) << 1) ^ (UINT32) ((v) >> 31))
+#define LOG_UNZIGZAG(u)	((int) ((u) >> 1) ^ -(int) ((u) & 1))
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL UINT32 spiLogKeys[SPI_LOG_MAX_CHANNELS];	/* channel keys */
+LOCAL int spiLogNKeys = 0;
+LOCAL int spiLogLast[SPI_LOG_MAX_CHANNELS];	/* last value in block */
+LOCAL int spiLogFd = ERROR;
+LOCAL int spiLogMax = 0;				/* blocks in file, 0 = no limit */
+LOCAL UINT8 *spiLogBase = 0L;			/* block ring or mapped file */
+LOCAL UINT8 *spiLogCur = 0L;			/* block being filled */
+LOCAL UINT32 spiLogTick = 0;			/* tick of previous record */
+LOCAL int spiLogUsed = 0;				/* record bytes in block */
+LOCAL int spiLogCount = 0;				/* records in block */
+LOCAL volatile UINT32 spiLogFill = 0;	/* blocks closed */
+LOCAL volatile UINT32 spiLogDrain = 0;	/* blocks written */
+LOCAL UINT32 spiLogSamples = 0;			/* samples logged */
+LOCAL UINT32 spiLogLost = 0;			/* samples dropped */
+LOCAL BOOL spiLogRunning = FALSE;
+#ifdef SPI_LOG_MMAP
+LOCAL size_t spiLogMapSize = 0;
+#else
+LOCAL UINT32 spiLogErrors = 0;			/* blocks not written */
+LOCAL int spiLogTid = 0;				/* writer task */
+LOCAL volatile BOOL spiLogQuit = FALSE;
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Forward declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void spiLogClose(void);
+LOCAL int spiLogVar(UINT8 *p, UINT32 v);
+LOCAL int spiLogGetVar(const UINT8 *p, const UINT8 *end, UINT32 *v);
+LOCAL int spiLogGetBlock(int fd, int k, UINT8 *buf);
+#ifndef SPI_LOG_MMAP
+LOCAL void spiLogTask(void);
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogStart
+//
+// Purpose: start logging samples to a file.
+//
+// Description: keys lists the SPI_KEY of each channel to log, as
+//		built by the device drivers, e.g.
+//		SPI_KEY(SPI_KEY_LTC1598, cs, ch).  blocks limits the file
+//		to that many blocks of SPI_LOG_BLOCK_SIZE bytes; 0 is no
+//		limit, which only the target supports since a mapped
+//		file is sized up front.  An existing file is replaced.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if logging is running, a parameter is out
+//		of range, or the file or the writer cannot be set up.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLogStart(char *fileName, UINT32 *keys, int nkeys, int blocks)
+{
+	UINT8 hdr[SPI_LOG_HDR_SIZE];
+	int iv;
+	int i;
+
+	if (spiLogRunning || (nkeys < 1) || (nkeys > SPI_LOG_MAX_CHANNELS) ||
+		(blocks < 0))
+		return ERROR;
+
+#ifdef SPI_LOG_MMAP
+	if (blocks == 0)
+		return ERROR;
+#endif
+
+	/*
+	// -----------------------------------------------------------
+	// file header.
+	// -----------------------------------------------------------
+	*/
+
+	memset((char *) hdr, 0, sizeof (hdr));
+
+	LOG_PUT32(hdr, SPI_LOG_MAGIC);
+	LOG_PUT16(hdr + 4, SPI_LOG_VERSION);
+	LOG_PUT16(hdr + 6, nkeys);
+	LOG_PUT32(hdr + 8, sysClkRateGet());
+	LOG_PUT32(hdr + 12, SPI_LOG_BLOCK_SIZE);
+
+	for (i = 0; i < nkeys; ++i) {
+		spiLogKeys[i] = keys[i];
+		LOG_PUT32(hdr + 16 + 4 * i, keys[i]);
+	}
+
+	spiLogNKeys = nkeys;
+	spiLogMax = blocks;
+	spiLogCur = 0L;
+	spiLogFill = 0;
+	spiLogDrain = 0;
+	spiLogSamples = 0;
+	spiLogLost = 0;
+#ifndef SPI_LOG_MMAP
+	spiLogErrors = 0;
+#endif
+
+	spiLogFd = open(fileName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (spiLogFd < 0)
+		return ERROR;
+
+#ifdef SPI_LOG_MMAP
+
+	/*
+	// -----------------------------------------------------------
+	// size the file and map it, header included.
+	// -----------------------------------------------------------
+	*/
+
+	spiLogMapSize = SPI_LOG_HDR_SIZE + (size_t) blocks * SPI_LOG_BLOCK_SIZE;
+
+	if (ftruncate(spiLogFd, (off_t) spiLogMapSize) != 0)
+		goto fail;
+
+	spiLogBase = (UINT8 *) mmap(0L, spiLogMapSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED, spiLogFd, 0);
+	if (spiLogBase == (UINT8 *) MAP_FAILED) {
+		spiLogBase = 0L;
+		goto fail;
+	}
+
+	memcpy(spiLogBase, hdr, SPI_LOG_HDR_SIZE);
+
+#else
+
+	/*
+	// -----------------------------------------------------------
+	// write the header, then set up the ring and its writer.
+	// -----------------------------------------------------------
+	*/
+
+	if (write(spiLogFd, (char *) hdr, SPI_LOG_HDR_SIZE) != SPI_LOG_HDR_SIZE)
+		goto fail;
+
+	spiLogBase = (UINT8 *) malloc(SPI_LOG_RING * SPI_LOG_BLOCK_SIZE);
+	if (spiLogBase == 0L)
+		goto fail;
+
+	spiLogQuit = FALSE;
+
+	spiLogTid = taskSpawn("tSpiLog", spiPriority + 1, spiOptions,
+		spiStackSize, (FUNCPTR) spiLogTask, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	if (spiLogTid == ERROR) {
+		spiLogTid = 0;
+		goto fail;
+	}
+
+#endif
+
+	/*
+	// -----------------------------------------------------------
+	// install the hook.
+	// -----------------------------------------------------------
+	*/
+
+	SPI_LOCK(iv);
+
+	spiValueHook = (FUNCPTR) spiLogPut;
+	spiLogRunning = TRUE;
+
+	SPI_UNLOCK(iv);
+
+	return OK;
+
+fail:
+#ifndef SPI_LOG_MMAP
+	free((char *) spiLogBase);
+	spiLogBase = 0L;
+#endif
+	close(spiLogFd);
+	spiLogFd = ERROR;
+
+	return ERROR;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogStop
+//
+// Purpose: stop logging and close the file.
+//
+// Description: Closes the block being filled, waits for the
+//		writer to catch up and cuts the file after the last
+//		block.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if logging is not running.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLogStop(void)
+{
+	int iv;
+
+	if (!spiLogRunning)
+		return ERROR;
+
+	SPI_LOCK(iv);
+
+	spiValueHook = 0;
+	spiLogRunning = FALSE;
+
+	if (spiLogCur)
+		spiLogClose();
+
+	SPI_UNLOCK(iv);
+
+#ifdef SPI_LOG_MMAP
+
+	msync(spiLogBase, spiLogMapSize, MS_SYNC);
+	munmap(spiLogBase, spiLogMapSize);
+	spiLogBase = 0L;
+
+	ftruncate(spiLogFd,
+		(off_t) SPI_LOG_HDR_SIZE + (off_t) spiLogFill * SPI_LOG_BLOCK_SIZE);
+
+#else
+
+	spiLogQuit = TRUE;
+
+	while (taskIdVerify(spiLogTid) == OK)
+		taskDelay(1);
+
+	spiLogTid = 0;
+
+	free((char *) spiLogBase);
+	spiLogBase = 0L;
+
+#endif
+
+	close(spiLogFd);
+	spiLogFd = ERROR;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogPut
+//
+// Purpose: log one sample.
+//
+// Description: key is the SPI_KEY of the channel; a channel not
+//		in the file is ignored.  The sample is stamped with the
+//		current tick.
+//
+// Architecture:
+//
+// Relationship: spiLib value hook, called by the device read
+//		PostOps.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level, or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiLogPut(UINT32 key, int value)
+{
+	UINT8 *p;
+	UINT32 t;
+	int i;
+
+	if (!spiLogRunning)
+		return;
+
+	for (i = 0; (i < spiLogNKeys) && (spiLogKeys[i] != key); ++i)
+		;
+
+	if (i >= spiLogNKeys)
+		return;
+
+	t = (UINT32) tickGet();
+
+	/*
+	// -----------------------------------------------------------
+	// close a block the record might not fit in.
+	// -----------------------------------------------------------
+	*/
+
+	if (spiLogCur && (spiLogUsed + SPI_LOG_REC_MAX >
+		SPI_LOG_BLOCK_SIZE - SPI_LOG_BLK_SIZE))
+		spiLogClose();
+
+	/*
+	// -----------------------------------------------------------
+	// start a block if there is room for one.
+	// -----------------------------------------------------------
+	*/
+
+	if (spiLogCur == 0L) {
+
+		if (spiLogMax && (spiLogFill >= (UINT32) spiLogMax)) {
+			spiLogLost++;
+			return;
+		}
+
+#ifdef SPI_LOG_MMAP
+		spiLogCur = spiLogBase + SPI_LOG_HDR_SIZE +
+			(size_t) spiLogFill * SPI_LOG_BLOCK_SIZE;
+#else
+		if (spiLogFill - spiLogDrain >= SPI_LOG_RING) {
+			spiLogLost++;
+			return;
+		}
+
+		spiLogCur = spiLogBase +
+			(spiLogFill % SPI_LOG_RING) * SPI_LOG_BLOCK_SIZE;
+#endif
+
+		LOG_PUT32(spiLogCur, t);
+		spiLogTick = t;
+		spiLogUsed = 0;
+		spiLogCount = 0;
+		memset((char *) spiLogLast, 0, spiLogNKeys * sizeof (int));
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// channel, tick delta, zigzag value delta.
+	// -----------------------------------------------------------
+	*/
+
+	p = spiLogCur + SPI_LOG_BLK_SIZE + spiLogUsed;
+
+	p[0] = (UINT8) i;
+	p += 1;
+	p += spiLogVar(p, t - spiLogTick);
+	p += spiLogVar(p, LOG_ZIGZAG(value - spiLogLast[i]));
+
+	spiLogUsed = p - (spiLogCur + SPI_LOG_BLK_SIZE);
+	spiLogCount++;
+	spiLogTick = t;
+	spiLogLast[i] = value;
+	spiLogSamples++;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogClose
+//
+// Purpose: close the block being filled.
+//
+// Description: Completes its header, clears the unused tail and
+//		passes it to the writer.
+//
+// Architecture:
+//
+// Relationship: Called by spiLogPut() and spiLogStop().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level, or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiLogClose(void)
+{
+	UINT8 *b = spiLogCur;
+
+	LOG_PUT16(b + 4, spiLogUsed);
+	LOG_PUT16(b + 6, spiLogCount);
+
+	memset((char *) b + SPI_LOG_BLK_SIZE + spiLogUsed, 0,
+		SPI_LOG_BLOCK_SIZE - SPI_LOG_BLK_SIZE - spiLogUsed);
+
+	spiLogCur = 0L;
+
+	SPI_BARRIER_W();
+	spiLogFill++;
+}
+
+
+#ifndef SPI_LOG_MMAP
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogTask
+//
+// Purpose: write closed blocks to the file.
+//
+// Description: Looks for closed blocks every tick.  Blocks are
+//		closed with SPI_LOCK held, where no semaphore may be
+//		given, so the writer polls rather than waits.  A block
+//		that cannot be written is counted and skipped, so the
+//		ring keeps moving; the file then lacks that block.
+//		spiLogQuit is read before the ring is drained, so the
+//		last pass starts after spiLogStop() closed the last
+//		block and writes it.
+//
+// Architecture:
+//
+// Relationship: Spawned by spiLogStart().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiLogTask(void)
+{
+	UINT8 *b;
+	BOOL quit;
+
+	for (;;) {
+
+		taskDelay(1);
+
+		quit = spiLogQuit;
+
+		SPI_BARRIER_R();
+
+		while (spiLogDrain != spiLogFill) {
+
+			SPI_BARRIER_R();
+
+			b = spiLogBase + (spiLogDrain % SPI_LOG_RING) * SPI_LOG_BLOCK_SIZE;
+
+			if (write(spiLogFd, (char *) b, SPI_LOG_BLOCK_SIZE) !=
+				SPI_LOG_BLOCK_SIZE)
+				spiLogErrors++;
+
+			spiLogDrain++;
+		}
+
+		if (quit)
+			break;
+	}
+}
+
+#endif	/* !SPI_LOG_MMAP */
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogVar
+//
+// Purpose: code a number in variable length.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: The number of bytes stored, 1 to 5.
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiLogVar(UINT8 *p, UINT32 v)
+{
+	int n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (UINT8) (v | 0x80);
+		v >>= 7;
+	}
+
+	p[n++] = (UINT8) v;
+
+	return n;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogGetVar
+//
+// Purpose: decode a number coded by spiLogVar().
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: The number of bytes used, or 0 if the number runs
+//		past end or is too long.
+//
+// Exception:
+//
+// Concurrency: Reentrant.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiLogGetVar(const UINT8 *p, const UINT8 *end, UINT32 *v)
+{
+	int n;
+
+	for (*v = 0, n = 0; (p + n < end) && (n < 5); ++n) {
+		*v |= (UINT32) (p[n] & 0x7f) << (7 * n);
+		if ((p[n] & 0x80) == 0)
+			return n + 1;
+	}
+
+	return 0;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogGetBlock
+//
+// Purpose: read block k of a log file.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if it cannot be read.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiLogGetBlock(int fd, int k, UINT8 *buf)
+{
+	if (lseek(fd, SPI_LOG_HDR_SIZE + (long) k * SPI_LOG_BLOCK_SIZE,
+		SEEK_SET) == ERROR)
+		return ERROR;
+
+	if (read(fd, (char *) buf, SPI_LOG_BLOCK_SIZE) != SPI_LOG_BLOCK_SIZE)
+		return ERROR;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogRead
+//
+// Purpose: read back the samples of a time range.
+//
+// Description: Calls fn(arg, key, tick, value) for every sample
+//		logged from tick from through tick to, in order.  The
+//		first block to decode is found by a binary search over
+//		the block ticks, so the cost depends on the length of
+//		the range rather than its place in the file.  Ticks are
+//		compared relative to the first block, which allows the
+//		tick counter to wrap once within a file; a from before
+//		the first block reads from the start of the file.  The
+//		file may be read while it is being logged to; the block
+//		being filled is not seen until it is closed.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: The number of samples passed to fn, or ERROR if the
+//		file cannot be read or is not a log file of this
+//		version and block size.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLogRead(char *fileName, UINT32 from, UINT32 to, FUNCPTR fn, int arg)
+{
+	UINT8 hdr[SPI_LOG_HDR_SIZE];
+	UINT32 keys[SPI_LOG_MAX_CHANNELS];
+	int last[SPI_LOG_MAX_CHANNELS];
+	UINT8 *buf;
+	const UINT8 *p;
+	const UINT8 *end;
+	UINT32 base;
+	UINT32 t;
+	UINT32 dt;
+	UINT32 dv;
+	int nkeys;
+	int nblocks;
+	int lo;
+	int hi;
+	int mid;
+	int len;
+	int fd;
+	int k;
+	int n;
+	int c;
+	int found = 0;
+
+	fd = open(fileName, O_RDONLY, 0);
+	if (fd < 0)
+		return ERROR;
+
+	buf = (UINT8 *) malloc(SPI_LOG_BLOCK_SIZE);
+	if (buf == 0L) {
+		close(fd);
+		return ERROR;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// check the header and count the blocks.
+	// -----------------------------------------------------------
+	*/
+
+	if ((read(fd, (char *) hdr, SPI_LOG_HDR_SIZE) != SPI_LOG_HDR_SIZE) ||
+		(LOG_GET32(hdr) != SPI_LOG_MAGIC) ||
+		(LOG_GET16(hdr + 4) != SPI_LOG_VERSION) ||
+		(LOG_GET32(hdr + 12) != SPI_LOG_BLOCK_SIZE) ||
+		((nkeys = LOG_GET16(hdr + 6)) > SPI_LOG_MAX_CHANNELS)) {
+		found = ERROR;
+		goto done;
+	}
+
+	for (k = 0; k < nkeys; ++k)
+		keys[k] = LOG_GET32(hdr + 16 + 4 * k);
+
+	nblocks = (int) ((lseek(fd, 0, SEEK_END) - SPI_LOG_HDR_SIZE) /
+		SPI_LOG_BLOCK_SIZE);
+
+	/*
+	// -----------------------------------------------------------
+	// last block starting at or before from; blocks never
+	// filled (count 0) at the end of a mapped file count as
+	// later than any tick.
+	// -----------------------------------------------------------
+	*/
+
+	if ((nblocks < 1) || (spiLogGetBlock(fd, 0, buf) == ERROR))
+		goto done;
+
+	base = LOG_GET32(buf);
+
+	if ((int) (to - base) < 0)
+		goto done;
+
+	if ((int) (from - base) < 0)
+		from = base;
+
+	for (lo = 0, hi = nblocks - 1; lo < hi; ) {
+
+		mid = (lo + hi + 1) / 2;
+
+		if (spiLogGetBlock(fd, mid, buf) == ERROR) {
+			found = ERROR;
+			goto done;
+		}
+
+		if ((LOG_GET16(buf + 6) != 0) &&
+			(LOG_GET32(buf) - base <= from - base))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// decode forward until past to.
+	// -----------------------------------------------------------
+	*/
+
+	for (k = lo; k < nblocks; ++k) {
+
+		if (spiLogGetBlock(fd, k, buf) == ERROR)
+			break;
+
+		if ((n = LOG_GET16(buf + 6)) == 0)
+			break;
+
+		t = LOG_GET32(buf);
+		if (t - base > to - base)
+			break;
+
+		p = buf + SPI_LOG_BLK_SIZE;
+		end = p + LOG_GET16(buf + 4);
+		if (end > buf + SPI_LOG_BLOCK_SIZE)
+			end = buf + SPI_LOG_BLOCK_SIZE;
+
+		memset((char *) last, 0, sizeof (last));
+
+		for (; n > 0; --n) {
+
+			if ((p >= end) || ((c = *p++) >= nkeys) ||
+				((len = spiLogGetVar(p, end, &dt)) == 0))
+				break;
+			p += len;
+
+			if ((len = spiLogGetVar(p, end, &dv)) == 0)
+				break;
+			p += len;
+
+			t += dt;
+			last[c] += LOG_UNZIGZAG(dv);
+
+			if (t - base > to - base)
+				goto done;
+
+			if (t - base >= from - base) {
+				(*fn)(arg, keys[c], t, last[c]);
+				++found;
+			}
+		}
+	}
+
+done:
+	free((char *) buf);
+	close(fd);
+
+	return found;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLogShow
+//
+// Purpose: print the logger counters.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: Called from the shell.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiLogShow(void)
+{
+	printf("%s, %d channels\n", spiLogRunning ? "logging" : "stopped",
+		spiLogNKeys);
+	printf("%10u samples\n", (unsigned int) spiLogSamples);
+	printf("%10u blocks closed\n", (unsigned int) spiLogFill);
+#ifndef SPI_LOG_MMAP
+	printf("%10u blocks written\n", (unsigned int) spiLogDrain);
+	printf("%10u write errors\n", (unsigned int) spiLogErrors);
+#endif
+	printf("%10u samples lost\n", (unsigned int) spiLogLost);
+}
@@ -0,0 +1,111 @@
+/*
+// ---------------------------------------------------------------
+// File: spiLog.h
+//
+// Module: SPI sample logger.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPILOG_H
+#define	SPILOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Logger limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_LOG_MAX_CHANNELS	32		/* channels per log file */
+#define SPI_LOG_BLOCK_SIZE		4096	/* bytes per block */
+#define SPI_LOG_RING			8		/* blocks buffered for the writer */
+
+
+/*
+// ---------------------------------------------------------------
+// Log file format.
+// ---------------------------------------------------------------
+*/
+
+/*
+// All fixed size fields are big-endian.  The file header is
+// followed by fixed size blocks, oldest first; block k starts at
+// byte SPI_LOG_HDR_SIZE + k * blocksize.  Each block starts a new
+// delta chain, so it can be decoded on its own, and the blocks are
+// in tick order, so a reader finds a point in time by a binary
+// search over the block ticks.
+//
+//	file header (SPI_LOG_HDR_SIZE bytes):
+//		u32 magic			SPI_LOG_MAGIC
+//		u16 version			SPI_LOG_VERSION
+//		u16 channels		channel keys in use
+//		u32 rate			ticks per second
+//		u32 blocksize		bytes per block
+//		u32 key[SPI_LOG_MAX_CHANNELS]	SPI_KEY of each channel, 0 if unused
+//
+//	block (blocksize bytes):
+//		u32 tick			tick of the first record
+//		u16 used			record bytes that follow
+//		u16 count			records that follow
+//		records
+//		zeros up to blocksize
+//
+//	record (3 to 11 bytes):
+//		u8  channel			index into key[]
+//		var dt				ticks since the previous record of the block
+//		var dv				value minus the previous value of the channel
+//							in the block, zigzag coded; the first value
+//							of a channel in a block is taken against 0
+//
+// A var is an unsigned 32-bit number in 7-bit groups, least
+// significant group first, with bit 7 set in every byte but the
+// last.  Zigzag coding maps 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+*/
+
+#define SPI_LOG_MAGIC		0x5350494c	/* "SPIL" */
+#define SPI_LOG_VERSION		1
+
+#define SPI_LOG_HDR_SIZE	(16 + 4 * SPI_LOG_MAX_CHANNELS)
+#define SPI_LOG_BLK_SIZE	8			/* block header */
+#define SPI_LOG_REC_MAX		11			/* largest record */
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern void spiLogPut(UINT32 key, int value);
+extern int spiLogRead(char *fileName, UINT32 from, UINT32 to, FUNCPTR fn,
+	int arg);
+extern void spiLogShow(void);
+extern int spiLogStart(char *fileName, UINT32 *keys, int nkeys, int blocks);
+extern int spiLogStop(void);
+#else
+extern void spiLogPut();
+extern int spiLogRead();
+extern void spiLogShow();
+extern int spiLogStart();
+extern int spiLogStop();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPILOG_H */
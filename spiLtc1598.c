@@ -34,12 +34,16 @@
 #include "iosLib.h"
 #include "intLib.h"
 #include "logLib.h"
+#include "tickLib.h"
+#ifndef SPI_SPIDEV
 #include "config.h"
 #include "m68360.h"
 #include "m68360UtHw.h"
 #include "MuxUtHw.h"
+#endif
 #include "spiLib.h"
 #include "spiLtc1598.h"
+#include "spiDecode.h"
 
 
 /*
@@ -49,12 +53,66 @@
 */
 
 
+/*
+// ---------------------------------------------------------------
+// Forward declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL SPI_LTC1598_CHIP *spiLtc1598Chip(int ChipSelect);
+LOCAL BOOL spiLtc1598Cached(SPI_LTC1598_CHIP *chip, int Channel, int *Data);
+LOCAL void spiLtc1598PrefetchNext(SPI_LTC1598_CHIP *chip, int Channel);
+LOCAL SPI_LTC1598_BATCH *spiLtc1598BatchJoin(int ChipSelect, int Channel,
+	int *Slot, BOOL *Lead);
+LOCAL int spiLtc1598BatchRead(SPI_LTC1598_BATCH *b, int Slot, BOOL Lead,
+	int *Data);
+LOCAL int spiLtc1598Scan(SPI_LTC1598_BATCH *b);
+LOCAL int spiLtc1598ReadCB(int Session, int ChipSelect, int Channel,
+	int *Data, int Deadline, BOOL Due);
+LOCAL void spiLtc1598TriggerCheck(int ChipSelect, int Channel, int Value);
+
+
 /*
 // ---------------------------------------------------------------
 // Local variables.
 // ---------------------------------------------------------------
 */
 
+LOCAL SPI_LTC1598_CHIP spiLtc1598Chips[SPI_LTC1598_MAX_CHIPS];
+
+LOCAL int spiLtc1598Fresh = 0;		/* prefetch freshness, 0 = off */
+LOCAL int spiLtc1598PfId = -1;		/* prefetch control block */
+LOCAL int spiLtc1598PfBusy = FALSE;	/* prefetch in progress */
+LOCAL int spiLtc1598PfData;			/* prefetch conversion result */
+LOCAL SPI_LTC1598_SAMPLE *spiLtc1598PfSample;
+LOCAL SPI_CMD spiLtc1598PfCmd[2];
+
+LOCAL SPI_LTC1598_BATCH spiLtc1598Batch[SPI_LTC1598_MAX_CHIPS];
+LOCAL int spiLtc1598Window = 0;		/* merge window in ticks, 0 = off */
+LOCAL SEM_ID spiLtc1598MergeMutex = 0L;
+
+LOCAL SPI_LTC1598_TRIGGER spiLtc1598Trig[SPI_LTC1598_MAX_TRIGGERS];
+LOCAL int spiLtc1598NTrig = 0;		/* active triggers */
+
+/* device hooks: channel select, read, oversampled read */
+LOCAL const SPI_OPS spiLtc1598SelectOps = {
+	(FUNCPTR) 0, (FUNCPTR) 0,
+	(FUNCPTR) spiPreLtc1598ChannelSelect,
+	(FUNCPTR) spiPostLtc1598ChannelSelect
+};
+
+LOCAL const SPI_OPS spiLtc1598ReadOps = {
+	(FUNCPTR) spiCsOnLtc1598, (FUNCPTR) spiCsOffLtc1598,
+	(FUNCPTR) spiPreLtc1598Read,
+	(FUNCPTR) spiPostLtc1598Read
+};
+
+LOCAL const SPI_OPS spiLtc1598OversampleOps = {
+	(FUNCPTR) spiCsOnLtc1598, (FUNCPTR) spiCsOffLtc1598,
+	(FUNCPTR) spiPreLtc1598Read,
+	(FUNCPTR) spiPostLtc1598Oversample
+};
+
 
 /*
 // ---------------------------------------------------------------
@@ -79,13 +137,43 @@
 void
 spiLtc1598Init(void)
 {
+	int i;
+	int ch;
+
+	/*
+	// -----------------------------------------------------------
+	// forget all access patterns.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0; i < SPI_LTC1598_MAX_CHIPS; ++i) {
+		spiLtc1598Chips[i].Cs = -1;
+		spiLtc1598Chips[i].Last = -1;
+		for (ch = 0; ch < SPI_LTC1598_CHANNELS; ++ch) {
+			spiLtc1598Chips[i].Next[ch] = -1;
+			spiLtc1598Chips[i].Cache[ch].Valid = FALSE;
+		}
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// no merged reads in progress.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0; i < SPI_LTC1598_MAX_CHIPS; ++i)
+		spiLtc1598Batch[i].Cs = -1;
+
 	/*
 	// -----------------------------------------------------------
-	// disable all bank chip selects
+	// disable all bank chip selects; on spidev the kernel
+	// drives them.
 	// -----------------------------------------------------------
 	*/
 
+#ifndef SPI_SPIDEV
 	*MUX360_SPICS_ADR = 0x1f;
+#endif
 }
 
 
@@ -114,9 +202,12 @@ spiCsOnLtc1598(SPI_CB *cb)
 {
 	SPI_CMD *cmd = cb->Cmd + cb->Index;
 
-	SPIDEBUG(("spiCsOnLtc1598: cs=%x\n", cmd->SPI_ARG_PARM0 & 0xff, 0, 0, 0, 0, 0));
+	SPIDEBUG(("spiCsOnLtc1598: cs=%x\n", (int) cmd->SPI_ARG_PARM0 & 0xff,
+		0, 0, 0, 0, 0));
 
+#ifndef SPI_SPIDEV
 	*MUX360_SPICS_ADR = (unsigned char) cmd->SPI_ARG_PARM0;
+#endif
 }
 
 
@@ -143,7 +234,9 @@ spiCsOnLtc1598(SPI_CB *cb)
 void
 spiCsOffLtc1598(SPI_CB *cb)
 {
+#ifndef SPI_SPIDEV
 	*MUX360_SPICS_ADR = 0x1f;
+#endif
 }
 
 
@@ -232,7 +325,8 @@ spiPreLtc1598ChannelSelect(SPI_CB *cb)
 //
 // Purpose: 
 //
-// Description:
+// Description: Also runs the window comparator triggers of the
+//		channel, if any, and passes the value to the value hook.
 //
 // Architecture:
 //
@@ -250,7 +344,6 @@ int
 spiPostLtc1598Read(SPI_CB *cb)
 {
 	SPI_CMD *cmd = cb->Cmd + cb->Index;
-	short d;
 	unsigned int *pi;
 
 	/*
@@ -259,15 +352,104 @@ spiPostLtc1598Read(SPI_CB *cb)
 	// -----------------------------------------------------------
 	*/
 
-	((char *) &d)[0] = cmd->RxBuf[0];
-	((char *) &d)[1] = cmd->RxBuf[1];
-
 	pi = (unsigned int *) cmd->SPI_ARG_PARM1;
-	*pi = (((unsigned int) d >> 1) & 0x0fff);
+	*pi = SPI_LTC1598_FRAME(cmd->RxBuf[0], cmd->RxBuf[1]);
+	cb->Value = *pi;
+
+	if (spiLtc1598NTrig)
+		spiLtc1598TriggerCheck(cmd->SPI_ARG_PARM0, cmd->SPI_ARG_PARM2,
+			cb->Value);
+
+	if (spiValueHook)
+		(*spiValueHook)(SPI_KEY(SPI_KEY_LTC1598, (int) cmd->SPI_ARG_PARM0,
+			(int) cmd->SPI_ARG_PARM2), cb->Value);
+
+	SPIDEBUG(("spiPostLtc1598Read: pi=%x *pi=%x RxBuf[0]=%x RxBuf[1]=%x\n",
+		pi, (unsigned int) *pi,
+		cmd->RxBuf[0] & 0xff, cmd->RxBuf[1] & 0xff, 0, 0));
+
+	/*
+	// -----------------------------------------------------------
+	// determine if this command block is completed.
+	// -----------------------------------------------------------
+	*/
+
+	cb->Index++;
+
+	return (cb->Index < cb->Count) ?
+		SPICB_STATE_QUEUE : SPICB_STATE_COMPLETE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiPostLtc1598Oversample
+//
+// Purpose: accumulate one conversion of an oversampled read.
+//
+// Description: The read command is repeated until the requested
+//		number of conversions has been accumulated in the
+//		SPI_LTC1598_ACC at SPI_ARG_PARM2; the averaged or
+//		decimated result is then stored through SPI_ARG_PARM1.
+//		Decimation keeps one extra bit per factor of four.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiPostLtc1598Oversample(SPI_CB *cb)
+{
+	SPI_CMD *cmd = cb->Cmd + cb->Index;
+	SPI_LTC1598_ACC *acc;
+	int v;
+	int n;
+
+	/*
+	// -----------------------------------------------------------
+	// extract value from ADC response and accumulate it.
+	// -----------------------------------------------------------
+	*/
+
+	v = SPI_LTC1598_FRAME(cmd->RxBuf[0], cmd->RxBuf[1]);
+
+	acc = (SPI_LTC1598_ACC *) cmd->SPI_ARG_PARM2;
+
+	if ((acc->Count == 0) || (v < acc->Min))
+		acc->Min = v;
+	if ((acc->Count == 0) || (v > acc->Max))
+		acc->Max = v;
+
+	acc->Sum += v;
+
+	if (++acc->Count < acc->Factor)
+		return SPICB_STATE_REPEAT;
+
+	/*
+	// -----------------------------------------------------------
+	// all conversions done - reduce to one value.
+	// -----------------------------------------------------------
+	*/
+
+	if (acc->Mode == SPI_LTC1598_DECIMATE) {
+
+		for (v = acc->Sum, n = acc->Factor; n >= 4; n >>= 2)
+			v >>= 1;
+
+	} else {
 
-	SPIDEBUG(("spiPostLtc1598Read: d=%x pi=%x *pi=%x RxBuf[0]=%x RxBuf[1]=%x\n",
-		(unsigned int) d, pi, (unsigned int) *pi,
-		cmd->RxBuf[0] & 0xff, cmd->RxBuf[1] & 0xff, 0));
+		v = (acc->Sum + acc->Factor / 2) / acc->Factor;
+	}
+
+	*(int *) cmd->SPI_ARG_PARM1 = v;
 
 	/*
 	// -----------------------------------------------------------
@@ -349,58 +531,204 @@ spiPreLtc1598Read(SPI_CB *cb)
 int
 spiLtc1598Read(int ChipSelect, int Channel, int *Data)
 {
-	int id;
+	return spiLtc1598ReadCB(ERROR, ChipSelect, Channel, Data, 0, FALSE);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598ReadDeadline
+//
+// Purpose: read a channel that is needed by a deadline.
+//
+// Description: Same as spiLtc1598Read(), with an absolute deadline
+//		in ticks passed to spiSchedDeadline().  Reads without a
+//		deadline are merged as set up by spiLtc1598Merge().
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiLtc1598Read(); ERROR with errno ETIMEDOUT if the
+//		read was refused because it could not meet the deadline.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598ReadDeadline(int ChipSelect, int Channel, int *Data, int Deadline)
+{
+	return spiLtc1598ReadCB(ERROR, ChipSelect, Channel, Data, Deadline, TRUE);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598ReadSession
+//
+// Purpose: read a channel on a control block the caller keeps.
+//
+// Description: Same as spiLtc1598Read(), but the read runs on
+//		Session, a control block from spiAllocate() that the
+//		caller holds for as many reads as it likes, instead of
+//		one allocated and freed for this read alone.  The key
+//		and preemption setting of Session are left as they
+//		were, so it can be used for other transfers in between.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiLtc1598Read().
+//
+// Exception:
+//
+// Concurrency: One read at a time per session.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598ReadSession(int Session, int ChipSelect, int Channel, int *Data)
+{
+	return spiLtc1598ReadCB(Session, ChipSelect, Channel, Data, 0, FALSE);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598ReadCB
+//
+// Purpose: read a channel.
+//
+// Description: Does the work of spiLtc1598Read(),
+//		spiLtc1598ReadDeadline() and spiLtc1598ReadSession();
+//		Deadline only counts if Due is TRUE.  With Session ERROR
+//		a control block is allocated for the read and freed
+//		after it; otherwise the session's key and preemption
+//		setting are restored after it.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiLtc1598ReadDeadline().
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiLtc1598ReadCB(int Session, int ChipSelect, int Channel, int *Data,
+	int Deadline, BOOL Due)
+{
+	int id = Session;
 	int ret;
-	SPI_CMD *pcmd;
+	int slot;
+	int key;
+	BOOL preempt;
+	BOOL lead;
 	SPI_CMD cmd[2];
+	SPI_LTC1598_CHIP *chip = 0L;
+	SPI_LTC1598_BATCH *batch;
 
 	/*
 	// -----------------------------------------------------------
-	// block 0 - format select channel command.
+	// learn the access pattern, use a prefetched sample if fresh.
 	// -----------------------------------------------------------
 	*/
 
-	pcmd = cmd + 0;
-	pcmd->Mode = SPICB_MODE_LTC1598;
-	pcmd->SPI_ARG_PARM0 = Channel;
-	pcmd->CsOff = (FUNCPTR) 0;
-	pcmd->CsOn = (FUNCPTR) 0;
-	pcmd->PostOp = (FUNCPTR) spiPostLtc1598ChannelSelect;
-	pcmd->PreOp = (FUNCPTR) spiPreLtc1598ChannelSelect;
+	if (spiLtc1598Fresh && (Channel >= 0) &&
+		(Channel < SPI_LTC1598_CHANNELS) &&
+		((chip = spiLtc1598Chip(ChipSelect)) != 0L)) {
+
+		if (chip->Last >= 0)
+			chip->Next[chip->Last] = Channel;
+		chip->Last = Channel;
+
+		if (spiLtc1598Cached(chip, Channel, Data)) {
+			spiLtc1598PrefetchNext(chip, Channel);
+			return OK;
+		}
+	}
 
 	/*
 	// -----------------------------------------------------------
-	// block 1 - format read command.
+	// merge with reads of other channels of this chip select.
+	// Reads with a deadline cannot wait for the merge window.
 	// -----------------------------------------------------------
 	*/
 
-	pcmd = cmd + 1;
-	pcmd->Mode = SPICB_MODE_LTC1598;
-	pcmd->SPI_ARG_PARM0 = (unsigned int) ChipSelect;
-	pcmd->SPI_ARG_PARM1 = (unsigned int) Data;
-	pcmd->CsOff = (FUNCPTR) spiCsOffLtc1598;
-	pcmd->CsOn = (FUNCPTR) spiCsOnLtc1598;
-	pcmd->PostOp = (FUNCPTR) spiPostLtc1598Read;
-	pcmd->PreOp = (FUNCPTR) spiPreLtc1598Read;
+	if (spiLtc1598Window && !Due && (Channel >= 0) &&
+		(Channel < SPI_LTC1598_CHANNELS) &&
+		((batch = spiLtc1598BatchJoin(ChipSelect, Channel, &slot, &lead))
+		!= 0L)) {
+
+		ret = spiLtc1598BatchRead(batch, slot, lead, Data);
+
+		if (chip)
+			spiLtc1598PrefetchNext(chip, Channel);
+
+		return ret;
+	}
 
 	/*
 	// -----------------------------------------------------------
-	// allocate control block.
+	// format select channel and read commands.
 	// -----------------------------------------------------------
 	*/
 
-	if ((id = spiAllocate()) == ERROR)
+	spiLtc1598Format(cmd, ChipSelect, Channel, Data);
+
+	/*
+	// -----------------------------------------------------------
+	// allocate control block unless the caller brought one.
+	// -----------------------------------------------------------
+	*/
+
+	if ((Session == ERROR) && ((id = spiAllocate()) == ERROR))
 		return ERROR;
 
+	/*
+	// -----------------------------------------------------------
+	// the selected channel must not change before the read;
+	// concurrent reads of the same channel share one transfer.
+	// A session gets its own settings back after the read.
+	// -----------------------------------------------------------
+	*/
+
+	key = SpiCB[id].Key;
+	preempt = !(SpiCB[id].Flags & SPICB_FLAG_NOPREEMPT);
+
+	spiSetPreempt(id, FALSE);
+	spiSetKey(id, SPI_KEY(SPI_KEY_LTC1598, ChipSelect, Channel));
+
 	/*
 	// -----------------------------------------------------------
 	// schedule command block(s).
 	// -----------------------------------------------------------
 	*/
 
-	if (spiSched(id,
-		cmd, (sizeof(cmd)/sizeof(cmd)[0]), SPI_SYNC, 0L) == ERROR)
+	if (Due)
+		ret = spiSchedDeadline(id, cmd, (sizeof(cmd)/sizeof(cmd)[0]),
+			SPI_SYNC, 0L, Deadline);
+	else
+		ret = spiSched(id, cmd, (sizeof(cmd)/sizeof(cmd)[0]), SPI_SYNC, 0L);
+
+	if (ret == ERROR) {
+
+		if (Session == ERROR)
+			spiFree(id);
+		else {
+			spiSetKey(id, key);
+			spiSetPreempt(id, preempt);
+		}
 		return ERROR;
+	}
 
 	/*
 	// -----------------------------------------------------------
@@ -421,11 +749,34 @@ spiLtc1598Read(int ChipSelect, int Channel, int *Data)
 
 	/*
 	// -----------------------------------------------------------
-	// free control block.
+	// a read that joined another one gets its result here.
 	// -----------------------------------------------------------
 	*/
 
-	spiFree(id);
+	if (ret == 0)
+		*Data = SpiCB[id].Value;
+
+	/*
+	// -----------------------------------------------------------
+	// free control block, a session keeps it.
+	// -----------------------------------------------------------
+	*/
+
+	if (Session == ERROR)
+		spiFree(id);
+	else {
+		spiSetKey(id, key);
+		spiSetPreempt(id, preempt);
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// sample the channel expected next while the bus is idle.
+	// -----------------------------------------------------------
+	*/
+
+	if (chip)
+		spiLtc1598PrefetchNext(chip, Channel);
 
 	/*
 	// -----------------------------------------------------------
@@ -435,3 +786,910 @@ spiLtc1598Read(int ChipSelect, int Channel, int *Data)
 
 	return ret;
 }
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598ReadOversample
+//
+// Purpose: read a channel with oversampling.
+//
+// Description: Runs Factor conversions of the channel within one
+//		control block, so the caller is woken once per result
+//		instead of once per conversion.  Mode selects the mean
+//		of the conversions (SPI_LTC1598_AVERAGE) or their sum
+//		scaled to 12 + n bits for Factor = 4^n
+//		(SPI_LTC1598_DECIMATE).  The smallest and largest
+//		conversions are returned through Min and Max unless
+//		they are NULL.
+//
+//		The conversions run back to back and cannot be
+//		preempted, so the bus is held for Factor conversions.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiLtc1598Read(); ERROR if Factor is out of range,
+//		Mode is unknown, or Factor is not a power of 4 for
+//		SPI_LTC1598_DECIMATE.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598ReadOversample(int ChipSelect, int Channel, int Factor, int Mode,
+	int *Data, int *Min, int *Max)
+{
+	int id;
+	int ret;
+	SPI_CMD cmd[2];
+	SPI_LTC1598_ACC acc;
+
+	if ((Factor < 1) || (Factor > SPI_LTC1598_MAX_OVERSAMPLE))
+		return ERROR;
+
+	if ((Mode != SPI_LTC1598_AVERAGE) && (Mode != SPI_LTC1598_DECIMATE))
+		return ERROR;
+
+	if ((Mode == SPI_LTC1598_DECIMATE) &&
+		(((Factor & (Factor - 1)) != 0) || !(Factor & 0x55555555)))
+		return ERROR;
+
+	acc.Factor = Factor;
+	acc.Mode = Mode;
+	acc.Count = 0;
+	acc.Sum = 0;
+	acc.Min = 0;
+	acc.Max = 0;
+
+	/*
+	// -----------------------------------------------------------
+	// format select channel and repeated read commands.
+	// -----------------------------------------------------------
+	*/
+
+	spiLtc1598Format(cmd, ChipSelect, Channel, Data);
+
+	cmd[1].SPI_ARG_PARM2 = (SPI_ARG) &acc;
+	cmd[1].Ops = &spiLtc1598OversampleOps;
+	cmd[1].Flags &= ~SPI_CMD_CHAIN;
+
+	/*
+	// -----------------------------------------------------------
+	// allocate control block.
+	// -----------------------------------------------------------
+	*/
+
+	if ((id = spiAllocate()) == ERROR)
+		return ERROR;
+
+	spiSetPreempt(id, FALSE);
+
+	/*
+	// -----------------------------------------------------------
+	// schedule command block(s).
+	// -----------------------------------------------------------
+	*/
+
+	if (spiSched(id,
+		cmd, (sizeof(cmd)/sizeof(cmd)[0]), SPI_SYNC, 0L) == ERROR) {
+
+		spiFree(id);
+		return ERROR;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// wait for comand(s) to be completed.
+	// -----------------------------------------------------------
+	*/
+
+	if ((ret = spiSync(id, WAIT_FOREVER)) == ERROR)
+		spiCancel(id);
+
+	spiFree(id);
+
+	if (Min)
+		*Min = acc.Min;
+	if (Max)
+		*Max = acc.Max;
+
+	return ret;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Format
+//
+// Purpose: format the command pair for a channel read.
+//
+// Description: Block 0 selects the channel, block 1 reads the
+//		conversion result into *Data.  The channel select must
+//		not be separated from the read, so control blocks that
+//		run these commands are made non-preemptible.
+//
+// Architecture:
+//
+// Relationship: cmd must have room for two command blocks.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+void
+spiLtc1598Format(SPI_CMD *cmd, int ChipSelect, int Channel, int *Data)
+{
+	SPI_CMD *pcmd;
+
+	memset((char *) cmd, 0, 2 * sizeof (SPI_CMD));
+
+	/*
+	// -----------------------------------------------------------
+	// block 0 - format select channel command.
+	// -----------------------------------------------------------
+	*/
+
+	pcmd = cmd + 0;
+	pcmd->Mode = SPICB_MODE_LTC1598;
+	pcmd->TxSize = pcmd->RxSize = 1;
+	pcmd->Flags = SPI_CMD_CHAIN;
+	pcmd->Cs = ChipSelect;
+	pcmd->SPI_ARG_PARM0 = Channel;
+	pcmd->Ops = &spiLtc1598SelectOps;
+
+	/*
+	// -----------------------------------------------------------
+	// block 1 - format read command.
+	// -----------------------------------------------------------
+	*/
+
+	pcmd = cmd + 1;
+	pcmd->Mode = SPICB_MODE_LTC1598;
+	pcmd->TxSize = pcmd->RxSize = 2;
+	pcmd->Flags = SPI_CMD_CHAIN;
+	pcmd->Cs = ChipSelect;
+	pcmd->SPI_ARG_PARM0 = ChipSelect;
+	pcmd->SPI_ARG_PARM1 = (SPI_ARG) Data;
+	pcmd->SPI_ARG_PARM2 = Channel;
+	pcmd->Ops = &spiLtc1598ReadOps;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Merge
+//
+// Purpose: enable or disable merging of concurrent reads.
+//
+// Description: While enabled, a spiLtc1598Read() on a chip select
+//		that has no merged read pending opens one.  While the bus
+//		is busy it waits, up to WindowTicks, for reads of other
+//		channels of the same chip select; with the bus idle it
+//		goes ahead at once.  All channels collected are then
+//		read in one control block, in one chip select window
+//		where the backend can keep it, without other devices in
+//		between, and each caller gets its own channel.  Reads of
+//		a channel already in the scan share its result.
+//		WindowTicks of 0 disables merging.
+//
+// Architecture:
+//
+// Relationship: spiLtc1598Init() must have been called.
+//
+// Returns: OK, or ERROR if the semaphores cannot be created.
+//
+// Exception:
+//
+// Concurrency: Must not be called while reads are in progress.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598Merge(int WindowTicks)
+{
+	int i;
+	SPI_LTC1598_BATCH *b;
+
+	if ((WindowTicks > 0) && (spiLtc1598MergeMutex == 0L)) {
+
+		spiLtc1598MergeMutex =
+			semMCreate(SEM_Q_PRIORITY | SEM_INVERSION_SAFE);
+		if (spiLtc1598MergeMutex == NULL)
+			return ERROR;
+
+		for (i = 0, b = spiLtc1598Batch; i < SPI_LTC1598_MAX_CHIPS;
+			 ++i, ++b) {
+			b->Done = semCCreate(SEM_Q_FIFO, 0);
+			if (b->Done == NULL)
+				break;
+		}
+
+		/*
+		// -------------------------------------------------------
+		// out of semaphores - delete those already created.
+		// -------------------------------------------------------
+		*/
+
+		if (i < SPI_LTC1598_MAX_CHIPS) {
+
+			while (--i >= 0) {
+				semDelete(spiLtc1598Batch[i].Done);
+				spiLtc1598Batch[i].Done = 0L;
+			}
+
+			semDelete(spiLtc1598MergeMutex);
+			spiLtc1598MergeMutex = 0L;
+
+			return ERROR;
+		}
+	}
+
+	spiLtc1598Window = (WindowTicks > 0) ? WindowTicks : 0;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Prefetch
+//
+// Purpose: enable or disable channel prefetching.
+//
+// Description: While enabled, spiLtc1598Read() records for every
+//		chip select which channel is read after which.  After
+//		each read, if the bus is idle, the channel expected next
+//		is sampled in the background at below-default priority
+//		and kept with its tick count.  A read of that channel
+//		within FreshTicks of the sample returns it without a bus
+//		transfer; each prefetched sample is returned only once.
+//		FreshTicks of 0 disables prefetching.
+//
+// Architecture:
+//
+// Relationship: spiLtc1598Init() must have been called.
+//
+// Returns: OK, or ERROR if no control block is available.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598Prefetch(int FreshTicks)
+{
+	int i;
+	int ch;
+
+	if ((FreshTicks > 0) && (spiLtc1598PfId < 0)) {
+
+		if ((spiLtc1598PfId = spiAllocate()) == ERROR) {
+			spiLtc1598PfId = -1;
+			return ERROR;
+		}
+
+		spiSetPriority(spiLtc1598PfId, -1);
+		spiSetPreempt(spiLtc1598PfId, FALSE);
+	}
+
+	spiLtc1598Fresh = (FreshTicks > 0) ? FreshTicks : 0;
+
+	for (i = 0; i < SPI_LTC1598_MAX_CHIPS; ++i)
+		for (ch = 0; ch < SPI_LTC1598_CHANNELS; ++ch)
+			spiLtc1598Chips[i].Cache[ch].Valid = FALSE;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598PrefetchDone
+//
+// Purpose: prefetch completion.
+//
+// Description: Stores the prefetched sample with its time stamp,
+//		unless a read of the channel joined the prefetch and so
+//		has returned the sample already.
+//
+// Architecture:
+//
+// Relationship: NotifyOp of the prefetch control block.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiLtc1598PrefetchDone(SPI_CB *cb)
+{
+	SPI_LTC1598_SAMPLE *sample = spiLtc1598PfSample;
+
+	if ((cb->State == SPICB_STATE_COMPLETE) && (cb->Error == 0) &&
+		(cb->Joined == 0)) {
+		sample->Value = cb->Value;
+		sample->Stamp = (int) tickGet();
+		sample->Valid = TRUE;
+	}
+
+	spiLtc1598PfBusy = FALSE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Chip
+//
+// Purpose: find or assign the pattern slot of a chip select.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: slot, or 0 if all slots are taken by other chips.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL SPI_LTC1598_CHIP *
+spiLtc1598Chip(int ChipSelect)
+{
+	int iv;
+	int i;
+	SPI_LTC1598_CHIP *chip = 0L;
+
+	SPI_LOCK(iv);
+
+	for (i = 0; i < SPI_LTC1598_MAX_CHIPS; ++i) {
+
+		if (spiLtc1598Chips[i].Cs == ChipSelect) {
+			chip = spiLtc1598Chips + i;
+			break;
+		}
+
+		if ((chip == 0L) && (spiLtc1598Chips[i].Cs == -1))
+			chip = spiLtc1598Chips + i;
+	}
+
+	if (chip && (chip->Cs == -1))
+		chip->Cs = ChipSelect;
+
+	SPI_UNLOCK(iv);
+
+	return chip;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Cached
+//
+// Purpose: consume a fresh prefetched sample.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: TRUE with the sample stored in *Data, or FALSE if
+//		there is no fresh sample for the channel.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL BOOL
+spiLtc1598Cached(SPI_LTC1598_CHIP *chip, int Channel, int *Data)
+{
+	int iv;
+	BOOL hit = FALSE;
+	SPI_LTC1598_SAMPLE *sample = chip->Cache + Channel;
+
+	SPI_LOCK(iv);
+
+	if (sample->Valid &&
+		((int) tickGet() - sample->Stamp <= spiLtc1598Fresh)) {
+
+		*Data = sample->Value;
+		hit = TRUE;
+	}
+
+	sample->Valid = FALSE;
+
+	SPI_UNLOCK(iv);
+
+	return hit;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598PrefetchNext
+//
+// Purpose: start sampling the channel expected after Channel.
+//
+// Description: Nothing is started if the bus is busy, a prefetch
+//		is already running or the expected channel already has
+//		a fresh sample.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiLtc1598PrefetchNext(SPI_LTC1598_CHIP *chip, int Channel)
+{
+	int iv;
+	int next;
+	SPI_LTC1598_SAMPLE *sample;
+
+	if ((spiLtc1598PfId < 0) || ((next = chip->Next[Channel]) < 0))
+		return;
+
+	sample = chip->Cache + next;
+
+	SPI_LOCK(iv);
+
+	/*
+	// -----------------------------------------------------------
+	// a cancelled prefetch is never notified.
+	// -----------------------------------------------------------
+	*/
+
+	if (SpiCB[spiLtc1598PfId].State == SPICB_STATE_ABORT)
+		spiLtc1598PfBusy = FALSE;
+
+	if (spiLtc1598PfBusy ||
+		(SpiHdr.State != SPIDEV_STATE_IDLE) || SpiHdr.CBHead ||
+		(sample->Valid &&
+		((int) tickGet() - sample->Stamp <= spiLtc1598Fresh))) {
+
+		SPI_UNLOCK(iv);
+		return;
+	}
+
+	spiLtc1598PfBusy = TRUE;
+
+	SPI_UNLOCK(iv);
+
+	spiLtc1598PfSample = sample;
+
+	spiLtc1598Format(spiLtc1598PfCmd, chip->Cs, next, &spiLtc1598PfData);
+
+	spiSetKey(spiLtc1598PfId, SPI_KEY(SPI_KEY_LTC1598, chip->Cs, next));
+
+	if (spiSched(spiLtc1598PfId, spiLtc1598PfCmd, 2, SPI_ASYNC_ISR,
+		(FUNCPTR) spiLtc1598PrefetchDone) == ERROR)
+		spiLtc1598PfBusy = FALSE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598BatchJoin
+//
+// Purpose: add a read to the merged read of its chip select.
+//
+// Description: Joins the open batch of the chip select, or opens
+//		a new one with the caller as leader.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: The batch, with the caller's channel slot in *Slot
+//		and *Lead set for the leader, or 0L if every batch is
+//		in use; the caller then reads on its own.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL SPI_LTC1598_BATCH *
+spiLtc1598BatchJoin(int ChipSelect, int Channel, int *Slot, BOOL *Lead)
+{
+	int i;
+	SPI_LTC1598_BATCH *b;
+	SPI_LTC1598_BATCH *unused = 0L;
+
+	semTake(spiLtc1598MergeMutex, WAIT_FOREVER);
+
+	for (i = 0, b = spiLtc1598Batch; i < SPI_LTC1598_MAX_CHIPS; ++i, ++b) {
+
+		if ((b->Cs == ChipSelect) && b->Open)
+			break;
+
+		if ((b->Cs < 0) && (unused == 0L))
+			unused = b;
+	}
+
+	if (i < SPI_LTC1598_MAX_CHIPS) {
+
+		/*
+		// -------------------------------------------------------
+		// join the open batch, sharing a channel already in it.
+		// -------------------------------------------------------
+		*/
+
+		for (i = 0; (i < b->Count) && (b->Channel[i] != Channel); ++i) ;
+
+		if (i == b->Count)
+			b->Channel[b->Count++] = Channel;
+
+		b->Users++;
+
+		*Slot = i;
+		*Lead = FALSE;
+
+	} else if ((b = unused) != 0L) {
+
+		/*
+		// -------------------------------------------------------
+		// open a new batch.
+		// -------------------------------------------------------
+		*/
+
+		b->Cs = ChipSelect;
+		b->Open = TRUE;
+		b->Count = 1;
+		b->Users = 1;
+		b->Error = 0;
+		b->Channel[0] = Channel;
+
+		*Slot = 0;
+		*Lead = TRUE;
+	}
+
+	semGive(spiLtc1598MergeMutex);
+
+	return b;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598BatchRead
+//
+// Purpose: complete a merged read.
+//
+// Description: The leader closes the batch, scans it and
+//		releases the other callers; they wait for that.  Before
+//		closing it waits a tick at a time, up to the merge
+//		window, while the bus is busy and channels are missing:
+//		a read would wait for the bus anyway, but with the bus
+//		idle waiting would only add latency.  The last caller to
+//		collect its result frees the batch.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiLtc1598Read().
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiLtc1598BatchRead(SPI_LTC1598_BATCH *b, int Slot, BOOL Lead, int *Data)
+{
+	int iv;
+	int n;
+	int ret;
+	int ticks;
+	BOOL idle;
+
+	if (Lead) {
+
+		for (ticks = 0; ticks < spiLtc1598Window; ++ticks) {
+
+			SPI_LOCK(iv);
+			idle = (SpiHdr.State == SPIDEV_STATE_IDLE) &&
+				(SpiHdr.CBHead == 0L) && (SpiHdr.Submit == 0L);
+			SPI_UNLOCK(iv);
+
+			if (idle || (b->Count == SPI_LTC1598_CHANNELS))
+				break;
+
+			taskDelay(1);
+		}
+
+		semTake(spiLtc1598MergeMutex, WAIT_FOREVER);
+		b->Open = FALSE;
+		n = b->Users;
+		semGive(spiLtc1598MergeMutex);
+
+		b->Error = spiLtc1598Scan(b);
+
+		while (--n > 0)
+			semGive(b->Done);
+
+	} else {
+
+		semTake(b->Done, WAIT_FOREVER);
+	}
+
+	if ((ret = b->Error) == 0)
+		*Data = b->Data[Slot];
+
+	semTake(spiLtc1598MergeMutex, WAIT_FOREVER);
+	if (--b->Users == 0)
+		b->Cs = -1;
+	semGive(spiLtc1598MergeMutex);
+
+	return ret;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Scan
+//
+// Purpose: read every channel of a closed batch.
+//
+// Description: Each channel is a channel select and read command
+//		pair; the control block keeps the bus for the whole
+//		scan.  Every command but the last is marked
+//		SPI_CMD_CSHOLD, so the scan shares one chip select
+//		window wherever the backend can keep it open between
+//		commands.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: 0, the error code of the control block, or ERROR.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiLtc1598Scan(SPI_LTC1598_BATCH *b)
+{
+	int i;
+	int id;
+	int ret;
+	SPI_CMD cmd[2 * SPI_LTC1598_CHANNELS];
+
+	for (i = 0; i < b->Count; ++i)
+		spiLtc1598Format(cmd + 2 * i, b->Cs, b->Channel[i], b->Data + i);
+
+	for (i = 0; i < 2 * b->Count - 1; ++i)
+		cmd[i].Flags |= SPI_CMD_CSHOLD;
+
+	if ((id = spiAllocate()) == ERROR)
+		return ERROR;
+
+	spiSetPreempt(id, FALSE);
+	spiSetBurst(id, 2 * b->Count);
+
+	if (spiSched(id, cmd, 2 * b->Count, SPI_SYNC, 0L) == ERROR) {
+		spiFree(id);
+		return ERROR;
+	}
+
+	if ((ret = spiSync(id, WAIT_FOREVER)) == ERROR)
+		spiCancel(id);
+
+	spiFree(id);
+
+	return ret;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598Trigger
+//
+// Purpose: watch a channel against a window.
+//
+// Description: Every read of the channel, whoever issues it, is
+//		compared with [Low, High] in its PostOp.  Fn is called
+//		only when Debounce samples in a row have been on the
+//		other side of the window: with SPI_ASYNC_ISR at
+//		interrupt level once the transfer's lock is released,
+//		under the rules of an SPI_ASYNC_ISR notification, with
+//		SPI_ASYNC_TASK from the SPI daemon.  Either way the
+//		PostOp only records the call, see spiDeferIsrLocked()
+//		and spiDeferLocked().  Oversampled reads are not
+//		compared.  The channel starts out inside.
+//
+// Architecture:
+//
+// Relationship: Something must read the channel, e.g. a
+//		spiSampleStart() table entry.
+//
+// Returns: The trigger slot, or ERROR if the arguments are
+//		invalid or all slots are in use.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598Trigger(int ChipSelect, int Channel, int Low, int High,
+	int Debounce, int Mode, FUNCPTR Fn, int Arg)
+{
+	int iv;
+	int i;
+	SPI_LTC1598_TRIGGER *t;
+
+	if ((Channel < 0) || (Channel >= SPI_LTC1598_CHANNELS) ||
+		(Low > High) || (Fn == 0L) ||
+		((Mode != SPI_ASYNC_ISR) && (Mode != SPI_ASYNC_TASK)))
+		return ERROR;
+
+	SPI_LOCK(iv);
+
+	for (i = 0, t = spiLtc1598Trig; i < SPI_LTC1598_MAX_TRIGGERS; ++i, ++t)
+		if (!t->Active)
+			break;
+
+	if (i < SPI_LTC1598_MAX_TRIGGERS) {
+		t->Cs = ChipSelect;
+		t->Channel = Channel;
+		t->Low = Low;
+		t->High = High;
+		t->Debounce = (Debounce > 1) ? Debounce : 1;
+		t->Mode = Mode;
+		t->Fn = Fn;
+		t->Arg = Arg;
+		t->Outside = FALSE;
+		t->Count = 0;
+		t->Active = TRUE;
+		spiLtc1598NTrig++;
+	}
+
+	SPI_UNLOCK(iv);
+
+	return (i < SPI_LTC1598_MAX_TRIGGERS) ? i : ERROR;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598TriggerClear
+//
+// Purpose: stop watching a channel.
+//
+// Description: A notification already recorded by the PostOp is
+//		still delivered.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if the slot is not in use.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiLtc1598TriggerClear(int Slot)
+{
+	int iv;
+	int ret = ERROR;
+
+	if ((Slot < 0) || (Slot >= SPI_LTC1598_MAX_TRIGGERS))
+		return ERROR;
+
+	SPI_LOCK(iv);
+
+	if (spiLtc1598Trig[Slot].Active) {
+		spiLtc1598Trig[Slot].Active = FALSE;
+		spiLtc1598NTrig--;
+		ret = OK;
+	}
+
+	SPI_UNLOCK(iv);
+
+	return ret;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiLtc1598TriggerCheck
+//
+// Purpose: compare a sample with the triggers of its channel.
+//
+// Description: A sample on the current side resets the debounce
+//		count; Debounce samples in a row on the other side
+//		switch sides and notify.  A notification that does not
+//		fit is counted in SpiStat.spiMsgsLost.
+//
+// Architecture:
+//
+// Relationship: Called by spiPostLtc1598Read().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level, under SPI_LOCK or SPI_ISR_LOCK.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiLtc1598TriggerCheck(int ChipSelect, int Channel, int Value)
+{
+	int i;
+	int outside;
+	int event;
+	SPI_LTC1598_TRIGGER *t;
+
+	for (i = 0, t = spiLtc1598Trig; i < SPI_LTC1598_MAX_TRIGGERS; ++i, ++t) {
+
+		if (!t->Active || (t->Cs != ChipSelect) || (t->Channel != Channel))
+			continue;
+
+		outside = (Value < t->Low) || (Value > t->High);
+
+		if (outside == t->Outside) {
+			t->Count = 0;
+			continue;
+		}
+
+		if (++t->Count < t->Debounce)
+			continue;
+
+		/*
+		// -------------------------------------------------------
+		// the sample changed sides for good.
+		// -------------------------------------------------------
+		*/
+
+		t->Count = 0;
+		t->Outside = outside;
+
+		event = Value | (outside ? SPI_LTC1598_OUTSIDE : 0);
+
+		if (((t->Mode == SPI_ASYNC_ISR) ?
+			spiDeferIsrLocked(t->Fn, t->Arg, event) :
+			spiDeferLocked(t->Fn, t->Arg, event)) == ERROR)
+			++SpiStat.spiMsgsLost;
+	}
+}
@@ -34,6 +34,8 @@ extern "C" {
 #define SPICB_MODE_LTC1598		0x0f77
 #endif
 
+#define SPI_KEY_LTC1598			1	/* single-flight device id */
+
 
 /*
 // ---------------------------------------------------------------
@@ -41,6 +43,11 @@ extern "C" {
 // ---------------------------------------------------------------
 */
 
+#define SPI_LTC1598_AVERAGE		0	/* oversample - mean of samples */
+#define SPI_LTC1598_DECIMATE	1	/* oversample - 12 + n bit result */
+
+#define SPI_LTC1598_OUTSIDE		0x10000	/* trigger event - left window */
+
 
 /*
 // ---------------------------------------------------------------
@@ -55,6 +62,11 @@ extern "C" {
 // ---------------------------------------------------------------
 */
 
+#define SPI_LTC1598_CHANNELS	8	/* analog inputs per chip */
+#define SPI_LTC1598_MAX_CHIPS	8	/* chip selects tracked for prefetch */
+#define SPI_LTC1598_MAX_OVERSAMPLE	256	/* conversions per oversampled read */
+#define SPI_LTC1598_MAX_TRIGGERS	16	/* window comparator triggers */
+
 
 /*
 // ---------------------------------------------------------------
@@ -62,6 +74,64 @@ extern "C" {
 // ---------------------------------------------------------------
 */
 
+/* prefetched sample */
+typedef struct {
+	int Value;			/* 12-bit conversion result */
+	int Stamp;			/* tick count when sampled */
+	int Valid;			/* sample not yet consumed */
+} SPI_LTC1598_SAMPLE;
+
+/* oversampling accumulator */
+typedef struct {
+	int Factor;			/* conversions to accumulate */
+	int Mode;			/* SPI_LTC1598_AVERAGE or _DECIMATE */
+	int Count;			/* conversions accumulated so far */
+	int Sum;
+	int Min;
+	int Max;
+} SPI_LTC1598_ACC;
+
+/* per chip select access pattern and prefetch cache */
+typedef struct {
+	int Cs;				/* chip select, -1 if slot unused */
+	int Last;			/* channel read last, -1 if none */
+	int Next[SPI_LTC1598_CHANNELS];	/* channel read after each channel */
+	SPI_LTC1598_SAMPLE Cache[SPI_LTC1598_CHANNELS];
+} SPI_LTC1598_CHIP;
+
+/*
+// A trigger routine is called as Fn(Arg, Event), Event being the
+// sample that completed the debounce, or'ed with
+// SPI_LTC1598_OUTSIDE when it left the window [Low, High].
+*/
+
+/* window comparator trigger */
+typedef struct {
+	int Active;			/* slot in use */
+	int Cs;				/* chip select */
+	int Channel;
+	int Low;			/* lowest value inside the window */
+	int High;			/* highest value inside the window */
+	int Debounce;		/* samples needed to change side */
+	int Mode;			/* SPI_ASYNC_ISR or SPI_ASYNC_TASK */
+	FUNCPTR Fn;
+	int Arg;
+	int Outside;		/* current side, starts inside */
+	int Count;			/* samples seen on the other side */
+} SPI_LTC1598_TRIGGER;
+
+/* reads of one chip select merged into a single scan */
+typedef struct {
+	int Cs;				/* chip select, -1 if slot unused */
+	int Open;			/* still accepting reads */
+	int Count;			/* channels in the scan */
+	int Users;			/* callers yet to collect their result */
+	int Error;			/* status of the scan */
+	int Channel[SPI_LTC1598_CHANNELS];
+	int Data[SPI_LTC1598_CHANNELS];
+	SEM_ID Done;		/* given once per waiting caller */
+} SPI_LTC1598_BATCH;
+
 
 /*
 // ---------------------------------------------------------------
@@ -75,18 +145,43 @@ extern void spiCsOnLtc1598(SPI_CB *cb);
 extern void spiCsOffLtc1598(SPI_CB *cb);
 extern int spiPostLtc1598ChannelSelect(SPI_CB *cb);
 extern int spiPreLtc1598ChannelSelect(SPI_CB *cb);
+extern int spiPostLtc1598Oversample(SPI_CB *cb);
 extern int spiPostLtc1598Read(SPI_CB *cb);
 extern int spiPreLtc1598Read(SPI_CB *cb);
+extern void spiLtc1598Format(SPI_CMD *cmd, int ChipSelect, int Channel,
+	int *Data);
+extern int spiLtc1598Merge(int WindowTicks);
+extern int spiLtc1598Prefetch(int FreshTicks);
+extern void spiLtc1598PrefetchDone(SPI_CB *cb);
 extern int spiLtc1598Read(int ChipSelect, int Channel, int *Data);
+extern int spiLtc1598ReadDeadline(int ChipSelect, int Channel, int *Data,
+	int Deadline);
+extern int spiLtc1598ReadOversample(int ChipSelect, int Channel, int Factor,
+	int Mode, int *Data, int *Min, int *Max);
+extern int spiLtc1598ReadSession(int Session, int ChipSelect, int Channel,
+	int *Data);
+extern int spiLtc1598Trigger(int ChipSelect, int Channel, int Low, int High,
+	int Debounce, int Mode, FUNCPTR Fn, int Arg);
+extern int spiLtc1598TriggerClear(int Slot);
 #else
 extern void spiLtc1598Init();
 extern void spiCsOnLtc1598();
 extern void spiCsOffLtc1598();
 extern int spiPostLtc1598ChannelSelect();
 extern int spiPreLtc1598ChannelSelect();
+extern int spiPostLtc1598Oversample();
 extern int spiPostLtc1598Read();
 extern int spiPreLtc1598Read();
+extern void spiLtc1598Format();
+extern int spiLtc1598Merge();
+extern int spiLtc1598Prefetch();
+extern void spiLtc1598PrefetchDone();
 extern int spiLtc1598Read();
+extern int spiLtc1598ReadDeadline();
+extern int spiLtc1598ReadOversample();
+extern int spiLtc1598ReadSession();
+extern int spiLtc1598Trigger();
+extern int spiLtc1598TriggerClear();
 #endif	/* __STDC__ */
 
 
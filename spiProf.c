@@ -0,0 +1,534 @@
+/*
+// ---------------------------------------------------------------
+// File: spiProf.c
+//
+// Module: SPI interrupt and lock profiler.
+//
+// Description: Measures how long spiLib keeps interrupts locked
+//		or runs at interrupt level, so that its share of the
+//		system interrupt latency can be shown: the interrupt
+//		handler, every SPI_LOCK window, the submission and
+//		spiCancel() windows in particular, and each device hook
+//		routine.
+//
+// Operation: Compiled into spiLib with SPI_PROFILE defined;
+//		otherwise the profiling macros in spiLib.h are empty
+//		and nothing here is called.  spiInit() calls
+//		spiProfReset(), which enables the BSP timestamp timer;
+//		nothing is recorded before.  Each section keeps a count,
+//		the maximum and a power of 2 histogram; hooks are kept
+//		per routine, up to SPI_PROF_MAX_HOOKS of them.
+//		spiProfShow() prints it all in microseconds.
+//
+//		A measured time includes the profiler's own timestamp
+//		reads and bookkeeping, so it is an upper bound.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "intLib.h"
+#include "sysLib.h"
+#include "spiLib.h"
+#include "spiProf.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+/* the profiler's own lock, never SPI_LOCK, which it measures */
+#ifdef _WRS_CONFIG_SMP
+#define PROF_LOCK(lvl)		{ (lvl) = 0; spinLockIsrTake(&spiProfSpin); }
+#define PROF_UNLOCK(lvl)	{ (void) (lvl); spinLockIsrGive(&spiProfSpin); }
+#else
+#define PROF_LOCK(lvl)		{ (lvl) = intLock(); }
+#define PROF_UNLOCK(lvl)	{ intUnlock(lvl); }
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL SPI_PROF_STAT spiProfSection[SPI_PROF_SECTIONS];
+LOCAL SPI_PROF_HOOK spiProfHook[SPI_PROF_MAX_HOOKS];
+LOCAL UINT32 spiProfHookLost = 0;		/* hook calls not recorded */
+LOCAL UINT32 spiProfPeriod = 0;			/* timestamp ticks per wrap */
+LOCAL BOOL spiProfReady = FALSE;
+LOCAL int spiProfDepth = 0;				/* SPI_LOCK nesting */
+LOCAL UINT32 spiProfLockStart = 0;		/* outermost SPI_LOCK taken */
+#ifdef _WRS_CONFIG_SMP
+LOCAL spinlockIsr_t spiProfSpin;
+#endif
+
+LOCAL char *spiProfSectionName[SPI_PROF_SECTIONS] = {
+	"isr", "lock", "sched", "cancel"
+};
+
+LOCAL char *spiProfKindName[SPI_PROF_KINDS] = {
+	"preop", "postop", "cson", "csoff", "notify"
+};
+
+
+/*
+// ---------------------------------------------------------------
+// Local function declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void spiProfAdd(SPI_PROF_STAT *stat, UINT32 start, UINT32 end);
+LOCAL void spiProfPrint(char *name, SPI_PROF_STAT *stat, UINT32 freq);
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfReset
+//
+// Purpose: clear the profile and start recording.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: Called by spiInit().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiProfReset(void)
+{
+	int lvl;
+
+#ifdef _WRS_CONFIG_SMP
+	if (!spiProfReady)
+		spinLockIsrInit(&spiProfSpin, 0);
+#endif
+
+	sysTimestampEnable();
+
+	PROF_LOCK(lvl);
+
+	memset((char *) spiProfSection, 0, sizeof (spiProfSection));
+	memset((char *) spiProfHook, 0, sizeof (spiProfHook));
+	spiProfHookLost = 0;
+	spiProfPeriod = sysTimestampPeriod();
+	spiProfReady = TRUE;
+
+	PROF_UNLOCK(lvl);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfStamp
+//
+// Purpose: read the timestamp timer.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: SPI_PROF_START().
+//
+// Returns: The current timestamp.
+//
+// Exception:
+//
+// Concurrency: Any level.
+//
+// ---------------------------------------------------------------
+*/
+UINT32
+spiProfStamp(void)
+{
+	return sysTimestamp();
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfRecord
+//
+// Purpose: record the end of a section.
+//
+// Description: start is the spiProfStamp() value at the start of
+//		the section.
+//
+// Architecture:
+//
+// Relationship: SPI_PROF_STOP().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Any level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiProfRecord(int section, UINT32 start)
+{
+	int lvl;
+	UINT32 end = sysTimestamp();
+
+	if (!spiProfReady || (section < 0) || (section >= SPI_PROF_SECTIONS))
+		return;
+
+	PROF_LOCK(lvl);
+	spiProfAdd(spiProfSection + section, start, end);
+	PROF_UNLOCK(lvl);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfLockTake
+//
+// Purpose: note that SPI_LOCK has been taken.
+//
+// Description: Only the outermost of nested SPI_LOCK windows is
+//		timed.
+//
+// Architecture:
+//
+// Relationship: SPI_LOCK.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: With SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiProfLockTake(void)
+{
+	if (spiProfDepth++ == 0)
+		spiProfLockStart = sysTimestamp();
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfLockGive
+//
+// Purpose: note that SPI_LOCK is about to be released.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: SPI_UNLOCK.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: With SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiProfLockGive(void)
+{
+	if (--spiProfDepth == 0)
+		spiProfRecord(SPI_PROF_LOCK, spiProfLockStart);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfCall
+//
+// Purpose: call a device hook and time it.
+//
+// Description: The first SPI_PROF_MAX_HOOKS distinct routines
+//		get a slot each; calls to any others are only counted
+//		as lost.
+//
+// Architecture:
+//
+// Relationship: SPI_HOOK().
+//
+// Returns: What the hook returns.
+//
+// Exception:
+//
+// Concurrency: Interrupt level or with SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiProfCall(int kind, FUNCPTR fn, struct SPI_CB *cb)
+{
+	int i;
+	int lvl;
+	int ret;
+	UINT32 start;
+	UINT32 end;
+	SPI_PROF_HOOK *hook;
+
+	start = sysTimestamp();
+	ret = (*fn)(cb);
+	end = sysTimestamp();
+
+	if (!spiProfReady)
+		return ret;
+
+	PROF_LOCK(lvl);
+
+	for (i = 0, hook = spiProfHook; i < SPI_PROF_MAX_HOOKS; ++i, ++hook) {
+
+		if (hook->Fn == 0) {
+			hook->Fn = fn;
+			hook->Kind = kind;
+		}
+
+		if ((hook->Fn == fn) && (hook->Kind == kind))
+			break;
+	}
+
+	if (i < SPI_PROF_MAX_HOOKS)
+		spiProfAdd(&hook->Stat, start, end);
+	else
+		spiProfHookLost++;
+
+	PROF_UNLOCK(lvl);
+
+	return ret;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfGet
+//
+// Purpose: copy the statistics of a section.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if section is out of range.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiProfGet(int section, SPI_PROF_STAT *stat)
+{
+	int lvl;
+
+	if ((section < 0) || (section >= SPI_PROF_SECTIONS))
+		return ERROR;
+
+	PROF_LOCK(lvl);
+	*stat = spiProfSection[section];
+	PROF_UNLOCK(lvl);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfGetHook
+//
+// Purpose: copy the statistics of a hook routine.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if slot is out of range or unused.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiProfGetHook(int slot, SPI_PROF_HOOK *hook)
+{
+	int lvl;
+
+	if ((slot < 0) || (slot >= SPI_PROF_MAX_HOOKS))
+		return ERROR;
+
+	PROF_LOCK(lvl);
+	*hook = spiProfHook[slot];
+	PROF_UNLOCK(lvl);
+
+	return (hook->Fn == 0) ? ERROR : OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfShow
+//
+// Purpose: print the profile.
+//
+// Description: Times are shown in microseconds, rounded up.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiProfShow(void)
+{
+	int i;
+	char name[32];
+	UINT32 freq = sysTimestampFreq();
+	SPI_PROF_HOOK hook;
+	SPI_PROF_STAT stat;
+
+	printf("%-20s %10s %10s\n", "section", "count", "max usec");
+
+	for (i = 0; i < SPI_PROF_SECTIONS; ++i) {
+		spiProfGet(i, &stat);
+		spiProfPrint(spiProfSectionName[i], &stat, freq);
+	}
+
+	for (i = 0; i < SPI_PROF_MAX_HOOKS; ++i) {
+		if (spiProfGetHook(i, &hook) == ERROR)
+			continue;
+		sprintf(name, "%s %#lx", spiProfKindName[hook.Kind],
+			(unsigned long) hook.Fn);
+		spiProfPrint(name, &hook.Stat, freq);
+	}
+
+	if (spiProfHookLost)
+		printf("%u hook calls not recorded\n", spiProfHookLost);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfAdd
+//
+// Purpose: add one measured time.
+//
+// Description: The timestamp timer wraps to 0 after
+//		spiProfPeriod ticks.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: With the profiler lock held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiProfAdd(SPI_PROF_STAT *stat, UINT32 start, UINT32 end)
+{
+	int b;
+	UINT32 t;
+
+	t = (end >= start) ? end - start : end + spiProfPeriod - start;
+
+	stat->Count++;
+
+	if (t > stat->Max)
+		stat->Max = t;
+
+	for (b = 0; (b < SPI_PROF_BUCKETS - 1) && (t >> (b + 1)); ++b) ;
+
+	stat->Hist[b]++;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProfPrint
+//
+// Purpose: print one line of the profile, plus its histogram.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+spiProfPrint(char *name, SPI_PROF_STAT *stat, UINT32 freq)
+{
+	int b;
+	UINT32 hi;
+
+	printf("%-20s %10u %10u\n", name, stat->Count,
+		(UINT32) (((double) stat->Max * 1000000.0 + freq - 1) / freq));
+
+	for (b = 0; b < SPI_PROF_BUCKETS; ++b) {
+
+		if (stat->Hist[b] == 0)
+			continue;
+
+		hi = (UINT32) ((((double) (2 << b) - 1.0) * 1000000.0 + freq - 1) /
+			freq);
+
+		if (b < SPI_PROF_BUCKETS - 1)
+			printf("    <= %8u usec %10u\n", hi, stat->Hist[b]);
+		else
+			printf("     > %8u usec %10u\n",
+				(UINT32) ((((double) (1 << b) - 1.0) * 1000000.0) / freq),
+				stat->Hist[b]);
+	}
+}
@@ -0,0 +1,123 @@
+/*
+// ---------------------------------------------------------------
+// File: spiProf.h
+//
+// Module: SPI interrupt and lock profiler.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPIPROF_H
+#define	SPIPROF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Profiled sections.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_PROF_ISR		0	/* spiIntr() */
+#define SPI_PROF_LOCK		1	/* any SPI_LOCK window */
+#define SPI_PROF_SCHED		2	/* submission taken in, locked */
+#define SPI_PROF_CANCEL		3	/* spiCancel() locked */
+#define SPI_PROF_SECTIONS	4
+
+/*
+// ---------------------------------------------------------------
+// Profiled device hooks.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_PROF_PREOP		0
+#define SPI_PROF_POSTOP		1
+#define SPI_PROF_CSON		2
+#define SPI_PROF_CSOFF		3
+#define SPI_PROF_NOTIFY		4	/* SPI_ASYNC_ISR NotifyOp */
+#define SPI_PROF_KINDS		5
+
+/*
+// ---------------------------------------------------------------
+// Profiler limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_PROF_MAX_HOOKS	16	/* distinct hook routines */
+#define SPI_PROF_BUCKETS	20	/* power of 2 histogram buckets */
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+/*
+// Times are in timestamp timer ticks, see spiProfShow() for
+// microseconds.  Hist[i] counts the times from 2^i up to
+// 2^(i+1) - 1 ticks; Hist[0] also counts 0 and the last bucket
+// everything longer.
+*/
+
+/* section or hook statistics */
+typedef struct {
+	UINT32 Count;		/* times measured */
+	UINT32 Max;			/* longest time */
+	UINT32 Hist[SPI_PROF_BUCKETS];
+} SPI_PROF_STAT;
+
+/* hook routine statistics */
+typedef struct {
+	FUNCPTR Fn;			/* hook routine, 0 if slot unused */
+	int Kind;			/* SPI_PROF_PREOP ... */
+	SPI_PROF_STAT Stat;
+} SPI_PROF_HOOK;
+
+struct SPI_CB;
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern int spiProfCall(int kind, FUNCPTR fn, struct SPI_CB *cb);
+extern int spiProfGet(int section, SPI_PROF_STAT *stat);
+extern int spiProfGetHook(int slot, SPI_PROF_HOOK *hook);
+extern void spiProfLockGive(void);
+extern void spiProfLockTake(void);
+extern void spiProfRecord(int section, UINT32 start);
+extern void spiProfReset(void);
+extern void spiProfShow(void);
+extern UINT32 spiProfStamp(void);
+#else
+extern int spiProfCall();
+extern int spiProfGet();
+extern int spiProfGetHook();
+extern void spiProfLockGive();
+extern void spiProfLockTake();
+extern void spiProfRecord();
+extern void spiProfReset();
+extern void spiProfShow();
+extern UINT32 spiProfStamp();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPIPROF_H */
@@ -0,0 +1,373 @@
+/*
+// ---------------------------------------------------------------
+// File: spiProg.c
+//
+// Module: SPI command program interpreter.
+//
+// Description: Runs small device protocols - transfer, wait for
+//		a status bit, branch on received data, loop, store
+//		results, delay - entirely at interrupt level, as the
+//		PreOp/PostOp of a single command block.
+//
+// Operation: The caller fills in the device part of an SPI_CMD
+//		(Mode, Cs, Flags, and Ops for CsOn/CsOff) and hands it
+//		with an SPI_PROG array to spiProgInit(), then schedules the
+//		command like any other.  spiProgRun() does all of this
+//		synchronously.  Every program starts with SPI_PROG_XFER,
+//		and every SPI_PROG_DELAY is followed by one, since the
+//		command resumes with a transfer after the delay.
+//		Setting SPI_CMD_CSHOLD keeps the chip select asserted
+//		from one transfer of the program to the next.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "semLib.h"
+#include "logLib.h"
+#include "spiLib.h"
+#include "spiProg.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_PROG_MAX_LENGTH	256	/* instructions per program */
+
+#define PROG_MATCH(ctx, ins) \
+	((((ctx)->Rx[(ins)->Index] & (ins)->Mask) & 0xff) == (ins)->Value)
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProgInit
+//
+// Purpose: attach a program to a command block.
+//
+// Description: Checks the program and sets up the command so
+//		that spiPreProg()/spiPostProg() interpret it.  The
+//		context holds the program state and receive buffer and
+//		must stay valid until the command has completed.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if the program is malformed, including a
+//		SPI_PROG_DELAY not followed by SPI_PROG_XFER.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+spiProgInit(SPI_CMD *cmd, SPI_PROG_CTX *ctx, SPI_PROG *prog)
+{
+	int n;
+	int i;
+	SPI_PROG *ins;
+
+	/*
+	// -----------------------------------------------------------
+	// find the program length.
+	// -----------------------------------------------------------
+	*/
+
+	for (n = 0; (n < SPI_PROG_MAX_LENGTH) && (prog[n].Op != SPI_PROG_END);
+		 ++n) ;
+
+	if ((n == 0) || (n == SPI_PROG_MAX_LENGTH) ||
+		(prog[0].Op != SPI_PROG_XFER))
+		return ERROR;
+
+	/*
+	// -----------------------------------------------------------
+	// check every instruction.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0, ins = prog; i < n; ++i, ++ins) {
+
+		switch (ins->Op) {
+
+		case SPI_PROG_XFER:
+			if ((ins->Count < 1) || (ins->Count > SPI_PROG_MAX_XFER))
+				return ERROR;
+			break;
+
+		case SPI_PROG_WAITBIT:
+		case SPI_PROG_BRANCH:
+			if ((ins->Index < 0) || (ins->Index >= SPI_PROG_MAX_XFER))
+				return ERROR;
+			if ((ins->Op == SPI_PROG_BRANCH) &&
+				((ins->Target < 0) || (ins->Target > n)))
+				return ERROR;
+			break;
+
+		case SPI_PROG_LOOP:
+			if ((ins->Index < 0) || (ins->Index >= SPI_PROG_MAX_LOOPS) ||
+				(ins->Target < 0) || (ins->Target > n))
+				return ERROR;
+			break;
+
+		case SPI_PROG_STORE:
+			if ((ins->Index < 0) || (ins->Count < 0) ||
+				(ins->Index + ins->Count > SPI_PROG_MAX_XFER))
+				return ERROR;
+			break;
+
+		case SPI_PROG_DELAY:
+			if ((i + 1 >= n) || (ins[1].Op != SPI_PROG_XFER))
+				return ERROR;
+			break;
+
+		default:
+			return ERROR;
+		}
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// reset the context and hook up the interpreter.
+	// -----------------------------------------------------------
+	*/
+
+	ctx->Prog = prog;
+	ctx->Pc = 0;
+	ctx->LastXfer = 0;
+	ctx->Retry = 0;
+
+	for (i = 0; i < SPI_PROG_MAX_LOOPS; ++i)
+		ctx->Loop[i] = 0;
+
+	cmd->RxBuf = ctx->Rx;
+	cmd->TxBuf = prog[0].Buf;
+	cmd->TxSize = cmd->RxSize = prog[0].Count;
+	cmd->SPI_ARG_PARM0 = (SPI_ARG) ctx;
+
+	ctx->Ops.CsOn = SPI_OP(cmd, CsOn);
+	ctx->Ops.CsOff = SPI_OP(cmd, CsOff);
+	ctx->Ops.PreOp = (FUNCPTR) spiPreProg;
+	ctx->Ops.PostOp = (FUNCPTR) spiPostProg;
+	cmd->Ops = &ctx->Ops;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiPreProg
+//
+// Purpose: set up the transfer at the current instruction.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: PreOp of a program command.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiPreProg(SPI_CB *cb)
+{
+	SPI_CMD *cmd = cb->Cmd + cb->Index;
+	SPI_PROG_CTX *ctx = (SPI_PROG_CTX *) cmd->SPI_ARG_PARM0;
+	SPI_PROG *ins = ctx->Prog + ctx->Pc;
+
+	cmd->TxBuf = ins->Buf;
+	cmd->RxBuf = ctx->Rx;
+	cmd->TxSize = ins->Count;
+	cmd->RxSize = cmd->TxSize;
+
+	return SPICB_STATE_RUN;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiPostProg
+//
+// Purpose: run the program up to its next transfer.
+//
+// Description: Called after each transfer with the received data
+//		in the context.  Control instructions are executed until
+//		the next SPI_PROG_XFER (the command is repeated for it),
+//		SPI_PROG_DELAY (the control block leaves the bus for
+//		Count ticks) or SPI_PROG_END.  SPI_PROG_WAITBIT repeats
+//		the last transfer until its bit test matches, at most
+//		Count times.  A program that runs more than
+//		SPI_PROG_MAX_STEPS instructions without a transfer is
+//		stopped.
+//
+// Architecture:
+//
+// Relationship: PostOp of a program command.
+//
+// Returns: SPICB_STATE_REPEAT, SPICB_STATE_DELAY, the usual end
+//		of command state, or SPICB_STATE_ERROR with cb->Error
+//		ETIMEDOUT (wait exhausted) or EIO (runaway program).
+//
+// Exception:
+//
+// Concurrency: Interrupt level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiPostProg(SPI_CB *cb)
+{
+	SPI_CMD *cmd = cb->Cmd + cb->Index;
+	SPI_PROG_CTX *ctx = (SPI_PROG_CTX *) cmd->SPI_ARG_PARM0;
+	SPI_PROG *ins;
+	int steps;
+
+	/*
+	// -----------------------------------------------------------
+	// the transfer at Pc is complete.
+	// -----------------------------------------------------------
+	*/
+
+	ctx->LastXfer = ctx->Pc++;
+
+	for (steps = 0; steps < SPI_PROG_MAX_STEPS; ++steps) {
+
+		ins = ctx->Prog + ctx->Pc;
+
+		switch (ins->Op) {
+
+		case SPI_PROG_XFER:
+			return SPICB_STATE_REPEAT;
+
+		case SPI_PROG_WAITBIT:
+			if (PROG_MATCH(ctx, ins)) {
+				ctx->Retry = 0;
+				ctx->Pc++;
+				break;
+			}
+
+			if (++ctx->Retry >= ins->Count) {
+				cb->Error = ETIMEDOUT;
+				cb->Return = ERROR;
+				return SPICB_STATE_ERROR;
+			}
+
+			ctx->Pc = ctx->LastXfer;
+			return SPICB_STATE_REPEAT;
+
+		case SPI_PROG_BRANCH:
+			ctx->Pc = PROG_MATCH(ctx, ins) ? ins->Target : ctx->Pc + 1;
+			break;
+
+		case SPI_PROG_LOOP:
+			if (++ctx->Loop[ins->Index] < ins->Count) {
+				ctx->Pc = ins->Target;
+			} else {
+				ctx->Loop[ins->Index] = 0;
+				ctx->Pc++;
+			}
+			break;
+
+		case SPI_PROG_STORE:
+			memcpy(ins->Buf, ctx->Rx + ins->Index, ins->Count);
+			ctx->Pc++;
+			break;
+
+		case SPI_PROG_DELAY:
+			cb->Delay = ins->Count;
+			ctx->Pc++;
+			return SPICB_STATE_DELAY;
+
+		default:
+
+			/*
+			// ---------------------------------------------------
+			// program complete.
+			// ---------------------------------------------------
+			*/
+
+			cb->Index++;
+
+			return (cb->Index < cb->Count) ?
+				SPICB_STATE_QUEUE : SPICB_STATE_COMPLETE;
+		}
+	}
+
+	cb->Error = EIO;
+	cb->Return = ERROR;
+	return SPICB_STATE_ERROR;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiProgRun
+//
+// Purpose: run a program synchronously.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: 0 when the program completed, otherwise ERROR or the
+//		error code of the control block.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiProgRun(SPI_CMD *cmd, SPI_PROG *prog)
+{
+	int id;
+	int ret;
+	SPI_PROG_CTX ctx;
+
+	if (spiProgInit(cmd, &ctx, prog) == ERROR)
+		return ERROR;
+
+	if ((id = spiAllocate()) == ERROR)
+		return ERROR;
+
+	if (spiSched(id, cmd, 1, SPI_SYNC, 0L) == ERROR) {
+		spiFree(id);
+		return ERROR;
+	}
+
+	if ((ret = spiSync(id, WAIT_FOREVER)) == ERROR)
+		spiCancel(id);
+
+	spiFree(id);
+
+	return ret;
+}
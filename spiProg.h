@@ -0,0 +1,109 @@
+/*
+// ---------------------------------------------------------------
+// File: spiProg.h
+//
+// Module: SPI command program interpreter.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPIPROG_H
+#define	SPIPROG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// SPI program instructions.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_PROG_END		0	/* program complete */
+#define SPI_PROG_XFER		1	/* transfer Count bytes from Buf */
+#define SPI_PROG_WAITBIT	2	/* redo last transfer until bits match */
+#define SPI_PROG_BRANCH		3	/* go to Target if bits match */
+#define SPI_PROG_LOOP		4	/* go to Target Count - 1 times */
+#define SPI_PROG_STORE		5	/* copy Count received bytes to Buf */
+#define SPI_PROG_DELAY		6	/* release the bus for Count ticks */
+
+
+/*
+// ---------------------------------------------------------------
+// SPI program limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_PROG_MAX_XFER	32	/* bytes per transfer */
+#define SPI_PROG_MAX_LOOPS	4	/* loop counters */
+#define SPI_PROG_MAX_STEPS	64	/* instructions between transfers */
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+/*
+// A bit test matches when (received byte Index & Mask) == Value.
+// SPI_PROG_LOOP uses Index to select one of SPI_PROG_MAX_LOOPS
+// counters.
+*/
+
+/* spi program instruction */
+typedef struct {
+	int Op;				/* SPI_PROG_xxx */
+	int Index;			/* received byte index or loop counter */
+	int Mask;			/* bit test mask */
+	int Value;			/* bit test value */
+	int Count;			/* bytes, retries, iterations or ticks */
+	int Target;			/* branch/loop destination */
+	char *Buf;			/* transmit data or store destination */
+} SPI_PROG;
+
+/* spi program execution context */
+typedef struct {
+	SPI_PROG *Prog;		/* program being run */
+	int Pc;				/* current instruction */
+	int LastXfer;		/* most recent transfer instruction */
+	int Retry;			/* SPI_PROG_WAITBIT attempts so far */
+	int Loop[SPI_PROG_MAX_LOOPS];
+	char Rx[SPI_PROG_MAX_XFER];
+	SPI_OPS Ops;		/* device chip select plus interpreter */
+} SPI_PROG_CTX;
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern int spiProgInit(SPI_CMD *cmd, SPI_PROG_CTX *ctx, SPI_PROG *prog);
+extern int spiProgRun(SPI_CMD *cmd, SPI_PROG *prog);
+extern int spiPostProg(SPI_CB *cb);
+extern int spiPreProg(SPI_CB *cb);
+#else
+extern int spiProgInit();
+extern int spiProgRun();
+extern int spiPostProg();
+extern int spiPreProg();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPIPROG_H */
@@ -0,0 +1,543 @@
+/*
+// ---------------------------------------------------------------
+// File: spiSample.c
+//
+// Module: SPI periodic sampling.
+//
+// Description: Samples a table of {device, channel, period}
+//		entries through the SPI queue and publishes the results
+//		in a snapshot that any number of readers can copy without
+//		bus traffic or locking.
+//
+// Operation: spiSampleStart() copies the table and spawns the
+//		sampler task.  Once per tick the task collects the entries
+//		that are due into one command list and schedules it on its
+//		own control block.  When the round completes, the
+//		interrupt level notification publishes all of its values
+//		together, so a snapshot never mixes the values of two
+//		rounds.
+//
+//		Entries with a filter chain (spiFilter.c) pass their
+//		samples through it in the notification, and only its
+//		output is published.  A round that yields no output
+//		publishes nothing, so readers blocked in spiSampleWait()
+//		wake once per decimation period rather than per sample.
+//
+//		The snapshot is double buffered under a sequence count.
+//		The writer makes the count odd, fills the back buffer
+//		and makes the count even again, which also flips the
+//		buffers.  Readers copy the front buffer and retry if the
+//		count was odd or changed during the copy.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "semLib.h"
+#include "taskLib.h"
+#include "tickLib.h"
+#include "logLib.h"
+#include "spiLib.h"
+#include "spiLtc1598.h"
+#include "spiTempSensor.h"
+#include "spiFilter.h"
+#include "spiSample.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL SPI_SAMPLE_ENTRY spiSampleTable[SPI_SAMPLE_MAX];
+LOCAL int spiSampleCount = 0;				/* entries in table */
+LOCAL int spiSampleNext[SPI_SAMPLE_MAX];	/* tick when entry is due */
+LOCAL int spiSampleRaw[SPI_SAMPLE_MAX];		/* values of current round */
+LOCAL int spiSampleDue[SPI_SAMPLE_MAX];		/* entries in current round */
+LOCAL int spiSampleNDue = 0;
+LOCAL int spiSampleStamp = 0;				/* tick of current round */
+LOCAL SPI_CMD spiSampleCmd[2 * SPI_SAMPLE_MAX];
+
+LOCAL int spiSampleId = ERROR;				/* sampler control block */
+LOCAL int spiSampleTid = 0;					/* sampler task */
+LOCAL volatile int spiSampleBusy = FALSE;	/* round in progress */
+LOCAL volatile int spiSampleQuit = FALSE;	/* sampler task to exit */
+
+LOCAL SPI_SAMPLE_SNAP spiSampleBuf[2];		/* front/back snapshot */
+LOCAL volatile unsigned int spiSampleSeq = 0;	/* odd while flipping */
+LOCAL SEM_ID spiSampleSem = 0L;				/* flushed on every publish */
+
+LOCAL SPI_FILTER spiSampleFilter[SPI_SAMPLE_MAX];	/* per entry filter */
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSampleStart
+//
+// Purpose: start periodic sampling.
+//
+// Description: The table is copied, so the caller's array need
+//		not stay valid.  Every entry is sampled in the first
+//		round.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if sampling is already running, the
+//		table or a filter configuration is invalid, or no
+//		control block, semaphore or task is available.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSampleStart(SPI_SAMPLE_ENTRY *table, int count)
+{
+	int i;
+	int now;
+	SPI_SAMPLE_ENTRY *e;
+
+	if (spiSampleTid != 0)
+		return ERROR;
+
+	if ((count < 1) || (count > SPI_SAMPLE_MAX))
+		return ERROR;
+
+	/*
+	// -----------------------------------------------------------
+	// check the table.
+	// -----------------------------------------------------------
+	*/
+
+	for (i = 0, e = table; i < count; ++i, ++e) {
+
+		if (e->Period < 1)
+			return ERROR;
+
+		if (e->Filter && (spiFilterInit(spiSampleFilter + i, e->Filter)
+			== ERROR))
+			return ERROR;
+
+		switch (e->Device) {
+
+		case SPI_SAMPLE_LTC1598:
+			if ((e->Channel < 0) || (e->Channel >= SPI_LTC1598_CHANNELS))
+				return ERROR;
+			break;
+
+		case SPI_SAMPLE_TEMPSENSOR:
+			break;
+
+		default:
+			return ERROR;
+		}
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// reset table and snapshot.
+	// -----------------------------------------------------------
+	*/
+
+	now = tickGet();
+
+	for (i = 0; i < count; ++i) {
+		spiSampleTable[i] = table[i];
+		spiSampleNext[i] = now;
+	}
+
+	spiSampleCount = count;
+	spiSampleNDue = 0;
+
+	memset((char *) spiSampleBuf, 0, sizeof (spiSampleBuf));
+	spiSampleBuf[0].Count = spiSampleBuf[1].Count = count;
+	spiSampleSeq = 0;
+
+	if ((spiSampleSem == 0L) &&
+		((spiSampleSem = semBCreate(SEM_Q_FIFO, SEM_EMPTY)) == 0L))
+		return ERROR;
+
+	/*
+	// -----------------------------------------------------------
+	// allocate the sampler control block.  LTC1598 reads must
+	// not be preempted between channel select and read; the
+	// burst keeps a whole round together on the bus unless a
+	// higher priority control block is waiting.
+	// -----------------------------------------------------------
+	*/
+
+	if ((spiSampleId = spiAllocate()) == ERROR)
+		return ERROR;
+
+	spiSetPreempt(spiSampleId, FALSE);
+	spiSetBurst(spiSampleId, 2 * SPI_SAMPLE_MAX);
+
+	spiSampleBusy = FALSE;
+	spiSampleQuit = FALSE;
+
+	spiSampleTid = taskSpawn("tSpiSample", spiPriority, spiOptions,
+		spiStackSize, (FUNCPTR) spiSampleTask, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	if (spiSampleTid == ERROR) {
+		spiSampleTid = 0;
+		spiFree(spiSampleId);
+		spiSampleId = ERROR;
+		return ERROR;
+	}
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSampleStop
+//
+// Purpose: stop periodic sampling.
+//
+// Description: Waits for the sampler task to exit; a round still
+//		on the bus is cancelled.  The last snapshot stays
+//		readable.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if sampling is not running.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSampleStop(void)
+{
+	if (spiSampleTid == 0)
+		return ERROR;
+
+	spiSampleQuit = TRUE;
+
+	while (taskIdVerify(spiSampleTid) == OK)
+		taskDelay(1);
+
+	spiFree(spiSampleId);
+
+	spiSampleId = ERROR;
+	spiSampleTid = 0;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSampleTask
+//
+// Purpose: schedule the entries that are due.
+//
+// Description: Wakes once per tick.  A round still on the bus
+//		holds back the next one; entries that fall due meanwhile
+//		are picked up as soon as it completes.  Entries are due
+//		again Period ticks after they were due, not after they
+//		ran, unless sampling has fallen a whole period behind.
+//		A round cancelled by spiCancel(), by the spiDaemon
+//		watchdog for one, is never notified; the task notices
+//		and starts the next round.
+//
+// Architecture:
+//
+// Relationship: Spawned by spiSampleStart().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiSampleTask(void)
+{
+	int iv;
+	int i;
+	int n;
+	int now;
+	SPI_CB *cb;
+	SPI_CMD *cmd;
+	SPI_SAMPLE_ENTRY *e;
+
+	for (;;) {
+
+		taskDelay(1);
+
+		if (spiSampleQuit) {
+			if (spiSampleBusy)
+				spiCancel(spiSampleId);
+			break;
+		}
+
+		/*
+		// -------------------------------------------------------
+		// a cancelled round is never notified.
+		// -------------------------------------------------------
+		*/
+
+		if (spiSampleBusy) {
+
+			cb = SpiCB + spiSampleId;
+
+			SPI_LOCK(iv);
+
+			if ((cb->State == SPICB_STATE_ABORT) ||
+				((cb->State == SPICB_STATE_COMPLETE) &&
+				(cb->Error == EINTR)))
+				spiSampleBusy = FALSE;
+
+			SPI_UNLOCK(iv);
+
+			if (spiSampleBusy)
+				continue;
+		}
+
+		/*
+		// -------------------------------------------------------
+		// collect due entries into one command list.
+		// -------------------------------------------------------
+		*/
+
+		now = tickGet();
+		cmd = spiSampleCmd;
+		n = 0;
+
+		for (i = 0, e = spiSampleTable; i < spiSampleCount; ++i, ++e) {
+
+			if ((now - spiSampleNext[i]) < 0)
+				continue;
+
+			spiSampleNext[i] += e->Period;
+
+			if ((now - spiSampleNext[i]) >= 0)
+				spiSampleNext[i] = now + e->Period;
+
+			if (e->Device == SPI_SAMPLE_LTC1598) {
+				spiLtc1598Format(cmd, e->Cs, e->Channel, spiSampleRaw + i);
+				cmd += 2;
+			} else {
+				spiTempSensorFormat(cmd, spiSampleRaw + i);
+				cmd += 1;
+			}
+
+			spiSampleDue[n++] = i;
+		}
+
+		if (n == 0)
+			continue;
+
+		/*
+		// -------------------------------------------------------
+		// run the round; spiSampleDone() publishes it.
+		// -------------------------------------------------------
+		*/
+
+		spiSampleNDue = n;
+		spiSampleStamp = now;
+		spiSampleBusy = TRUE;
+
+		if (spiSched(spiSampleId, spiSampleCmd, cmd - spiSampleCmd,
+			SPI_ASYNC_ISR, (FUNCPTR) spiSampleDone) == ERROR) {
+			SPIDEBUG(("spiSampleTask: spiSched failed\n", 0, 0, 0, 0, 0, 0));
+			spiSampleBusy = FALSE;
+		}
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSampleDone
+//
+// Purpose: publish a completed sampling round.
+//
+// Description: Samples of filtered entries go through their
+//		filter chains first; the entries without an output this
+//		round are dropped from it.  The back buffer is brought
+//		up to date from the front buffer plus the values of this
+//		round, then the buffers are flipped and the waiting
+//		readers woken.  A failed round, or one without values,
+//		publishes nothing; its entries keep their previous value
+//		and stamp.
+//
+// Architecture:
+//
+// Relationship: NotifyOp of the sampler control block.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt level; the only writer of the snapshot.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiSampleDone(SPI_CB *cb)
+{
+	unsigned int seq;
+	SPI_SAMPLE_SNAP *front;
+	SPI_SAMPLE_SNAP *back;
+	int i;
+	int k;
+	int n;
+
+	if ((cb->State == SPICB_STATE_COMPLETE) && (cb->Error == 0)) {
+
+		/*
+		// -------------------------------------------------------
+		// filter; keep the entries that have a value to publish.
+		// -------------------------------------------------------
+		*/
+
+		for (k = 0, n = 0; k < spiSampleNDue; ++k) {
+			i = spiSampleDue[k];
+			if (spiSampleTable[i].Filter &&
+				!spiFilterPut(spiSampleFilter + i, spiSampleRaw[i],
+				spiSampleRaw + i))
+				continue;
+			spiSampleDue[n++] = i;
+		}
+
+		spiSampleNDue = n;
+	}
+
+	if ((cb->State == SPICB_STATE_COMPLETE) && (cb->Error == 0) &&
+		(spiSampleNDue > 0)) {
+
+		/*
+		// -------------------------------------------------------
+		// odd count while the buffers change.
+		// -------------------------------------------------------
+		*/
+
+		seq = spiSampleSeq;
+		front = spiSampleBuf + ((seq >> 1) & 1);
+		back = spiSampleBuf + (((seq >> 1) + 1) & 1);
+
+		spiSampleSeq = seq + 1;
+
+		SPI_BARRIER_W();
+
+		*back = *front;
+
+		for (k = 0; k < spiSampleNDue; ++k) {
+			i = spiSampleDue[k];
+			back->Value[i] = spiSampleRaw[i];
+			back->Stamp[i] = spiSampleStamp;
+		}
+
+		back->Round++;
+
+		SPI_BARRIER_W();
+
+		spiSampleSeq = seq + 2;
+
+		semFlush(spiSampleSem);
+	}
+
+	spiSampleBusy = FALSE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSampleRead
+//
+// Purpose: copy the latest sampled values.
+//
+// Description: The copy holds the values of whole rounds only.
+//		The writer makes the sequence count odd before it touches
+//		either buffer and even again when it is done, so a copy
+//		is retried if the count was odd or changed while it was
+//		being taken.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR if nothing has been sampled yet.
+//
+// Exception:
+//
+// Concurrency: Any task, without locking; never blocks the
+//		writer.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSampleRead(SPI_SAMPLE_SNAP *snap)
+{
+	unsigned int seq;
+
+	do {
+		seq = spiSampleSeq;
+		SPI_BARRIER_R();
+		*snap = spiSampleBuf[(seq >> 1) & 1];
+		SPI_BARRIER_R();
+	} while ((seq & 1) || (spiSampleSeq != seq));
+
+	return (snap->Round > 0) ? OK : ERROR;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSampleWait
+//
+// Purpose: wait for the next publish and copy the values.
+//
+// Description: Blocks until spiSampleDone() publishes again, then
+//		does what spiSampleRead() does.  Any number of readers
+//		may wait; all of them are woken.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: OK, or ERROR on timeout or if sampling was never
+//		started.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSampleWait(SPI_SAMPLE_SNAP *snap, int timeout)
+{
+	if ((spiSampleSem == 0L) || (semTake(spiSampleSem, timeout) == ERROR))
+		return ERROR;
+
+	return spiSampleRead(snap);
+}
@@ -0,0 +1,105 @@
+/*
+// ---------------------------------------------------------------
+// File: spiSample.h
+//
+// Module: SPI periodic sampling.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPISAMPLE_H
+#define	SPISAMPLE_H
+
+#include "spiFilter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Sampled devices.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_SAMPLE_LTC1598		1	/* LTC1598 ADC channel */
+#define SPI_SAMPLE_TEMPSENSOR	2	/* temperature sensor, Cs/Channel unused */
+
+
+/*
+// ---------------------------------------------------------------
+// Sampling limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_SAMPLE_MAX			16	/* entries in the sampling table */
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+/* sampling table entry */
+typedef struct {
+	int Device;			/* SPI_SAMPLE_xxx */
+	int Cs;				/* chip select */
+	int Channel;		/* device channel */
+	int Period;			/* ticks between samples */
+	SPI_FILTER_CFG *Filter;	/* filter chain, 0 for raw samples */
+} SPI_SAMPLE_ENTRY;
+
+/*
+// Value[i] and Stamp[i] belong to entry i of the sampling table.
+// Stamp is the tick count of the sampling round that produced the
+// value, 0 until the entry has been sampled.  A filtered entry
+// gets a value only when its filter chain produces one, once per
+// decimation period.
+*/
+
+/* sampled values */
+typedef struct {
+	int Count;			/* entries in the sampling table */
+	int Round;			/* sampling rounds published */
+	int Value[SPI_SAMPLE_MAX];
+	int Stamp[SPI_SAMPLE_MAX];
+} SPI_SAMPLE_SNAP;
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern void spiSampleDone(SPI_CB *cb);
+extern int spiSampleRead(SPI_SAMPLE_SNAP *snap);
+extern int spiSampleStart(SPI_SAMPLE_ENTRY *table, int count);
+extern int spiSampleStop(void);
+extern void spiSampleTask(void);
+extern int spiSampleWait(SPI_SAMPLE_SNAP *snap, int timeout);
+#else
+extern void spiSampleDone();
+extern int spiSampleRead();
+extern int spiSampleStart();
+extern int spiSampleStop();
+extern void spiSampleTask();
+extern int spiSampleWait();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPISAMPLE_H */
@@ -0,0 +1,726 @@
+/*
+// ---------------------------------------------------------------
+// File: spiSpidev.c
+//
+// Module: SPI Linux spidev backend.
+//
+// Description: Runs the spiLib queue and the device drivers on a
+//		Linux board, with the kernel spidev driver in place of
+//		the 68360 SPI controller.  Built with SPI_SPIDEV defined,
+//		which also compiles the controller and chip select code
+//		out of spiLib and the drivers.
+//
+// Operation: spiInit() calls spiSpidevInit(), which spawns the
+//		transfer task.  spiStart() wakes it instead of starting
+//		the controller.  Each chip select identity (SPI_CMD.Cs)
+//		is bound to a /dev/spidevB.C file with spiSpidevOpen()
+//		or spiSpidevAttach(); the kernel drives the chip select.
+//
+//		The task turns the current command of the running
+//		control block, and as many following commands as are
+//		marked SPI_CMD_CHAIN for the same file and SPI mode, into
+//		one SPI_IOC_MESSAGE(n) ioctl.  cs_change deselects the
+//		device between transfers unless SPI_CMD_CSHOLD is set;
+//		spiSpidevDelay gives the delay after each transfer.
+//		The completions are then run in order as if each command
+//		had interrupted on its own.  Chained commands are one
+//		turn on the bus: the burst limit does not split them,
+//		and a higher priority control block waiting when the
+//		message is built keeps it to one transfer.
+//
+//		Every transfer has its own slot in the message buffers,
+//		since the drivers format successive commands in the same
+//		spiTxBuffer/spiRxBuffer.  The received bytes are copied
+//		back to RxBuf just before the PostOp; the start and done
+//		hooks both run after the message has completed.
+//
+//		spiSpidevIoctl may be pointed at a fake ioctl routine,
+//		with spiSpidevAttach() binding made up file descriptors,
+//		to run the drivers without hardware.  test/ builds the
+//		library on a Linux host this way, with a VxWorks shim.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "ioLib.h"
+#include "intLib.h"
+#include "semLib.h"
+#include "taskLib.h"
+#include "logLib.h"
+#include "errnoLib.h"
+#include "spiLib.h"
+#include "spiSpidev.h"
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define SPMODE_LOOP		0x4000	/* local loopback */
+#define SPMODE_CI		0x2000	/* clock invert */
+#define SPMODE_CP		0x1000	/* clock phase */
+#define SPMODE_DIV16	0x0800	/* divide by 16 */
+#define SPMODE_REV		0x0400	/* reverse data, msb first */
+
+#define SPMODE_BITS(m)	((((m) >> 4) & 0x0f) + 1)
+#define SPMODE_PM(m)	((m) & 0x0f)
+
+
+/*
+// ---------------------------------------------------------------
+// Global variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int spiSpidevSysIoctl(int fd, unsigned long request, void *arg);
+
+int (*spiSpidevIoctl)(int fd, unsigned long request, void *arg) =
+	spiSpidevSysIoctl;
+int spiSpidevDelay = 0;		/* usec after each transfer */
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int spiSpidevFd[SPI_SPIDEV_MAX_CS];	/* file, -1 if unbound */
+LOCAL int spiSpidevMode[SPI_SPIDEV_MAX_CS];	/* SPI mode set, -1 if none */
+LOCAL SEM_ID spiSpidevKick = 0;				/* transfer task wake-up */
+LOCAL volatile BOOL spiSpidevKicked = FALSE;	/* wake-up not yet given */
+LOCAL int spiSpidevTid = 0;					/* transfer task */
+
+LOCAL struct spi_ioc_transfer spiSpidevXfer[SPI_SPIDEV_MAX_XFER];
+LOCAL char spiSpidevTx[SPI_SPIDEV_MAX_BYTES];
+LOCAL char spiSpidevRx[SPI_SPIDEV_MAX_BYTES];
+
+
+/*
+// ---------------------------------------------------------------
+// Local function declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int spiSpidevModeOf(int mode);
+LOCAL int spiSpidevSpeedOf(int mode);
+LOCAL int spiSpidevBuild(SPI_HDR *h, SPI_CB *cb, int *pcs, int *perror);
+LOCAL SPI_CB *spiSpidevPost(SPI_HDR *h, SPI_CB *cb, int n, int error);
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevInit
+//
+// Purpose: start the spidev backend.
+//
+// Description: No chip select is bound afterwards.
+//
+// Architecture:
+//
+// Relationship: Called by spiInit().
+//
+// Returns: OK, or ERROR if the semaphore or task cannot be
+//		created.
+//
+// Exception:
+//
+// Concurrency: Task level.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSpidevInit(SPI_HDR *h)
+{
+	int i;
+
+	for (i = 0; i < SPI_SPIDEV_MAX_CS; ++i) {
+		spiSpidevFd[i] = -1;
+		spiSpidevMode[i] = -1;
+	}
+
+	spiSpidevKick = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+	if (spiSpidevKick == NULL)
+		return ERROR;
+
+	spiSpidevTid = taskSpawn("tSpiSpidev", spiPriority, spiOptions,
+		spiStackSize, (FUNCPTR) spiSpidevTask, (SPI_ARG) h,
+		0, 0, 0, 0, 0, 0, 0, 0, 0);
+	if (spiSpidevTid == ERROR) {
+		spiSpidevTid = 0;
+		return ERROR;
+	}
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevAttach
+//
+// Purpose: bind a chip select identity to an open spidev file.
+//
+// Description: Commands with SPI_CMD.Cs == cs go to fd.  A fake
+//		ioctl layer may pass any descriptor it recognizes.
+//
+// Architecture:
+//
+// Relationship: After spiInit().
+//
+// Returns: OK, or ERROR if cs is out of range.
+//
+// Exception:
+//
+// Concurrency: Task level, while no command for cs is queued.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSpidevAttach(int cs, int fd)
+{
+	if ((cs < 0) || (cs >= SPI_SPIDEV_MAX_CS))
+		return ERROR;
+
+	spiSpidevFd[cs] = fd;
+	spiSpidevMode[cs] = -1;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevOpen
+//
+// Purpose: bind a chip select identity to a spidev device.
+//
+// Description: Opens path, e.g. "/dev/spidev0.1", and attaches
+//		it to cs.
+//
+// Architecture:
+//
+// Relationship: After spiInit().
+//
+// Returns: OK, or ERROR if cs is out of range or path cannot be
+//		opened.
+//
+// Exception:
+//
+// Concurrency: Task level, while no command for cs is queued.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiSpidevOpen(int cs, char *path)
+{
+	int fd;
+
+	if ((cs < 0) || (cs >= SPI_SPIDEV_MAX_CS))
+		return ERROR;
+
+	if ((fd = open(path, O_RDWR, 0)) < 0)
+		return ERROR;
+
+	return spiSpidevAttach(cs, fd);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevStart
+//
+// Purpose: start transferring the running control block.
+//
+// Description: Only marks the transfer task to be woken, since no
+//		semaphore may be given under SPI_LOCK; spiSpidevWake()
+//		wakes it after the unlock.
+//
+// Architecture:
+//
+// Relationship: Called by spiStart() in place of starting the
+//		controller.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: With SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiSpidevStart(void)
+{
+	spiSpidevKicked = TRUE;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevWake
+//
+// Purpose: wake the transfer task if spiSpidevStart() asked to.
+//
+// Description: The flag is cleared before the semaphore is given,
+//		so a start marked meanwhile on another CPU is not lost.
+//
+// Architecture:
+//
+// Relationship: Called by spiDeferFlush().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Interrupt or task level, without SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiSpidevWake(void)
+{
+	if (spiSpidevKicked) {
+		spiSpidevKicked = FALSE;
+		semGive(spiSpidevKick);
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevTask
+//
+// Purpose: run the queued commands through spidev.
+//
+// Description: Submits one message per pass until the run queue
+//		is empty, then waits for spiSpidevStart().  The device
+//		is marked idle under the same lock as the completion
+//		that empties the run queue, since a submitter that
+//		still sees it busy leaves the start to this task.  A
+//		control block cancelled while its message was in the
+//		kernel is left alone; the transfers are discarded.
+//
+// Architecture:
+//
+// Relationship: Spawned by spiSpidevInit().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Task level; the only task that calls the spidev
+//		ioctls.
+//
+// ---------------------------------------------------------------
+*/
+void
+spiSpidevTask(SPI_HDR *h)
+{
+	int iv;
+	int n;
+	int cs;
+	int ret;
+	int first;
+	int error;
+	UINT8 mode;
+	SPI_CB *cb;
+	SPI_CB *done;
+
+	for (;;) {
+
+		semTake(spiSpidevKick, WAIT_FOREVER);
+
+		for (;;) {
+
+			done = 0L;
+
+			SPI_LOCK(iv);
+
+			if ((cb = h->RunCB) == 0L) {
+				h->State = SPIDEV_STATE_IDLE;
+				SPI_UNLOCK(iv);
+				break;
+			}
+
+			/*
+			// ---------------------------------------------------
+			// build the message.
+			// ---------------------------------------------------
+			*/
+
+			first = cb->Index;
+			cb->State = SPICB_STATE_RUN;
+
+			error = 0;
+			n = spiSpidevBuild(h, cb, &cs, &error);
+
+			if (n == 0) {
+				done = spiXferDone(h, error, FALSE);
+				if (h->RunCB == 0L)
+					h->State = SPIDEV_STATE_IDLE;
+				SPI_UNLOCK(iv);
+				spiDeferFlush();
+				spiNotify(done);
+				continue;
+			}
+
+			mode = (UINT8) spiSpidevModeOf(cb->Cmd[first].Mode);
+
+			SPI_UNLOCK(iv);
+
+			/*
+			// ---------------------------------------------------
+			// submit it.
+			// ---------------------------------------------------
+			*/
+
+			ret = OK;
+
+			if (spiSpidevMode[cs] != mode) {
+				ret = (*spiSpidevIoctl)(spiSpidevFd[cs], SPI_IOC_WR_MODE,
+					&mode);
+				spiSpidevMode[cs] = (ret < 0) ? -1 : mode;
+			}
+
+			if (ret >= 0)
+				ret = (*spiSpidevIoctl)(spiSpidevFd[cs],
+					SPI_IOC_MESSAGE(n), spiSpidevXfer);
+
+			if (ret < 0)
+				SPIDEBUG(("spiSpidevTask: cs=%d n=%d errno=%x\n",
+					cs, n, errnoGet(), 0, 0, 0));
+
+			/*
+			// ---------------------------------------------------
+			// complete the commands, unless cancelled meanwhile.
+			// ---------------------------------------------------
+			*/
+
+			SPI_LOCK(iv);
+
+			h->IsStalled = FALSE;
+
+			if ((h->RunCB == cb) && (cb->Index == first) &&
+				(cb->State == SPICB_STATE_RUN))
+				done = spiSpidevPost(h, cb, n, (ret < 0) ? EIO : 0);
+
+			if (h->RunCB == 0L)
+				h->State = SPIDEV_STATE_IDLE;
+
+			SPI_UNLOCK(iv);
+
+			spiDeferFlush();
+
+			if (done)
+				spiNotify(done);
+		}
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevBuild
+//
+// Purpose: fill in the message for the running control block.
+//
+// Description: Runs the PreOp of each command taken into the
+//		message and copies its transmit data into the message
+//		buffer.  cb->Index is left at the first command.  The
+//		chip select identity of the message is stored in *pcs.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: Number of transfers, or 0 with *perror set if the
+//		first command cannot be sent: ENODEV for an unbound
+//		chip select, EMSGSIZE for a transfer larger than
+//		SPI_SPIDEV_MAX_BYTES.
+//
+// Exception:
+//
+// Concurrency: With SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiSpidevBuild(SPI_HDR *h, SPI_CB *cb, int *pcs, int *perror)
+{
+	int i;
+	int n = 0;
+	int len;
+	int off = 0;
+	int first = cb->Index;
+	BOOL chain = TRUE;
+	SPI_CB *q;
+	SPI_CMD *cmd;
+	struct spi_ioc_transfer *x;
+
+	*pcs = cb->Cmd[first].Cs;
+
+	if ((*pcs < 0) || (*pcs >= SPI_SPIDEV_MAX_CS) ||
+		(spiSpidevFd[*pcs] < 0)) {
+		*perror = ENODEV;
+		return 0;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// a higher priority control block gets the bus after one
+	// transfer.
+	// -----------------------------------------------------------
+	*/
+
+	if (!(cb->Flags & SPICB_FLAG_NOPREEMPT))
+		for (q = h->CBHead; q; q = q->Next)
+			if (q->RunPriority > cb->RunPriority)
+				chain = FALSE;
+
+	for (i = first; (i < cb->Count) && (n < SPI_SPIDEV_MAX_XFER); ++i) {
+
+		cmd = cb->Cmd + i;
+
+		if ((n > 0) && ((cmd->Cs != *pcs) ||
+			(spiSpidevModeOf(cmd->Mode) !=
+			 spiSpidevModeOf(cb->Cmd[first].Mode))))
+			break;
+
+		cb->Index = i;
+
+		if (SPI_OP(cmd, PreOp))
+			SPI_HOOK(SPI_PROF_PREOP, cmd->Ops->PreOp, cb);
+
+		len = (cmd->TxSize > cmd->RxSize) ? cmd->TxSize : cmd->RxSize;
+
+		if (off + len > SPI_SPIDEV_MAX_BYTES) {
+			if (n == 0)
+				*perror = EMSGSIZE;
+			break;
+		}
+
+		/*
+		// -------------------------------------------------------
+		// transfer n, in its own part of the message buffers.
+		// -------------------------------------------------------
+		*/
+
+		memset(spiSpidevTx + off, 0, len);
+		if (cmd->TxBuf)
+			memcpy(spiSpidevTx + off, cmd->TxBuf, cmd->TxSize);
+
+		x = spiSpidevXfer + n;
+		memset((char *) x, 0, sizeof (*x));
+
+		x->tx_buf = (unsigned long) (spiSpidevTx + off);
+		x->rx_buf = (unsigned long) (spiSpidevRx + off);
+		x->len = len;
+		x->speed_hz = spiSpidevSpeedOf(cmd->Mode);
+		x->bits_per_word = SPMODE_BITS(cmd->Mode);
+		x->delay_usecs = spiSpidevDelay;
+		x->cs_change = !(cmd->Flags & SPI_CMD_CSHOLD);
+
+		off += len;
+		n++;
+
+		if (!(cmd->Flags & SPI_CMD_CHAIN) || !chain)
+			break;
+	}
+
+	/*
+	// -----------------------------------------------------------
+	// on the last transfer cs_change keeps the device selected
+	// after the message instead.
+	// -----------------------------------------------------------
+	*/
+
+	if (n > 0)
+		spiSpidevXfer[n - 1].cs_change = !spiSpidevXfer[n - 1].cs_change;
+
+	cb->Index = first;
+
+	return n;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevPost
+//
+// Purpose: complete the commands of a message.
+//
+// Description: Hands each transfer's received data to its
+//		command and completes it with spiXferDone().  If a
+//		PostOp does not advance to the next command of the
+//		message, the remaining transfers are discarded.  The
+//		start hook of a transfer runs here too, after the
+//		message, since the kernel does not report when each
+//		transfer started; spiCapture marks these records
+//		SPI_CAPTURE_UNTIMED.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: The control block to notify, or 0.
+//
+// Exception:
+//
+// Concurrency: With SPI_LOCK held.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL SPI_CB *
+spiSpidevPost(SPI_HDR *h, SPI_CB *cb, int n, int error)
+{
+	int k;
+	int first = cb->Index;
+	char *tx;
+	SPI_CB *done = 0L;
+	SPI_CMD *cmd;
+	struct spi_ioc_transfer *x;
+
+	for (k = 0; k < n; ++k) {
+
+		cmd = cb->Cmd + cb->Index;
+		x = spiSpidevXfer + k;
+
+		if ((error == 0) && cmd->RxBuf)
+			memcpy(cmd->RxBuf, (char *) (unsigned long) x->rx_buf,
+				cmd->RxSize);
+
+		if (spiStartHook) {
+			tx = cmd->TxBuf;
+			cmd->TxBuf = (char *) (unsigned long) x->tx_buf;
+			(*spiStartHook)(cb, cmd);
+			cmd->TxBuf = tx;
+		}
+
+		done = spiXferDone(h, error, k < n - 1);
+
+		if (done || (h->RunCB != cb) || (cb->Index != first + k + 1))
+			break;
+	}
+
+	return done;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevModeOf
+//
+// Purpose: translate SPMODE to the spidev SPI mode.
+//
+// Description: CI is the clock polarity and CP the clock phase;
+//		without REV the 68360 sends the least significant bit
+//		first.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: SPI_CPOL, SPI_CPHA, SPI_LSB_FIRST and SPI_LOOP bits.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiSpidevModeOf(int mode)
+{
+	int m = 0;
+
+	if (mode & SPMODE_CI)
+		m |= SPI_CPOL;
+	if (mode & SPMODE_CP)
+		m |= SPI_CPHA;
+	if (!(mode & SPMODE_REV))
+		m |= SPI_LSB_FIRST;
+	if (mode & SPMODE_LOOP)
+		m |= SPI_LOOP;
+
+	return m;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevSpeedOf
+//
+// Purpose: translate SPMODE to a clock rate.
+//
+// Description: The rate the 68360 baud rate generator would run
+//		at with spiClockMHz, as in spiWireTime().
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: Clock rate in Hz.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiSpidevSpeedOf(int mode)
+{
+	int div = 4 * (SPMODE_PM(mode) + 1);
+
+	if (mode & SPMODE_DIV16)
+		div *= 16;
+
+	return (spiClockMHz * 1000000) / div;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiSpidevSysIoctl
+//
+// Purpose: default spiSpidevIoctl routine.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: As ioctl().
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiSpidevSysIoctl(int fd, unsigned long request, void *arg)
+{
+	return ioctl(fd, request, arg);
+}
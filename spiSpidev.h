@@ -0,0 +1,67 @@
+/*
+// ---------------------------------------------------------------
+// File: spiSpidev.h
+//
+// Module: SPI Linux spidev backend.
+//
+// Description:
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	SPISPIDEV_H
+#define	SPISPIDEV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Backend limits.
+// ---------------------------------------------------------------
+*/
+
+#define SPI_SPIDEV_MAX_CS		256	/* chip select identities */
+#define SPI_SPIDEV_MAX_XFER		16	/* transfers per message */
+#define SPI_SPIDEV_MAX_BYTES	(4 * SPI_BUFFER_SIZE)	/* per message */
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern int (*spiSpidevIoctl)(int fd, unsigned long request, void *arg);
+extern int spiSpidevDelay;
+extern int spiSpidevAttach(int cs, int fd);
+extern int spiSpidevInit(SPI_HDR *h);
+extern int spiSpidevOpen(int cs, char *path);
+extern void spiSpidevStart(void);
+extern void spiSpidevTask(SPI_HDR *h);
+extern void spiSpidevWake(void);
+#else
+extern int (*spiSpidevIoctl)();
+extern int spiSpidevDelay;
+extern int spiSpidevAttach();
+extern int spiSpidevInit();
+extern int spiSpidevOpen();
+extern void spiSpidevStart();
+extern void spiSpidevTask();
+extern void spiSpidevWake();
+#endif	/* __STDC__ */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPISPIDEV_H */
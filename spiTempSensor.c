@@ -34,9 +34,11 @@
 #include "iosLib.h"
 #include "intLib.h"
 #include "logLib.h"
+#ifndef SPI_SPIDEV
 #include "config.h"
 #include "m68360.h"
 #include "m68360UtHw.h"
+#endif
 #include "spiLib.h"
 #include "spiTempSensor.h"
 
@@ -48,12 +50,28 @@
 */
 
 
+/*
+// ---------------------------------------------------------------
+// Forward declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int spiTempSensorReadCB(int Session, int *piCelsius);
+
+
 /*
 // ---------------------------------------------------------------
 // Local variables.
 // ---------------------------------------------------------------
 */
 
+/* device hooks */
+LOCAL const SPI_OPS spiTempSensorOps = {
+	(FUNCPTR) spiCsOnTempSensor, (FUNCPTR) spiCsOffTempSensor,
+	(FUNCPTR) spiPreTempSensorRead,
+	(FUNCPTR) spiPostTempSensorRead
+};
+
 
 /*
 // ---------------------------------------------------------------
@@ -78,6 +96,7 @@
 void
 spiTempSensorInit(void)
 {
+#ifndef SPI_SPIDEV
 	/* setup ambient temperature sensor chip select */
 	*M360_CPM_PCPAR(M_ADRS) &= ~PC_SPI_TMPSEL;
 			/* general purpose i/o */
@@ -85,6 +104,7 @@ spiTempSensorInit(void)
 			/* active output */
 	*M360_CPM_PCDAT(M_ADRS) |= PC_SPI_TMPSEL;
 			/* negate chip select */
+#endif
 }
 
 
@@ -111,9 +131,11 @@ spiTempSensorInit(void)
 void
 spiCsOnTempSensor(void)
 {
+#ifndef SPI_SPIDEV
 	extern int Reg16And();
 
 	Reg16And(M360_CPM_PCDAT(M_ADRS), ~PC_SPI_TMPSEL);
+#endif
 }
 
 
@@ -140,9 +162,11 @@ spiCsOnTempSensor(void)
 void
 spiCsOffTempSensor(void)
 {
+#ifndef SPI_SPIDEV
 	extern int Reg16Or();
 
 	Reg16Or(M360_CPM_PCDAT(M_ADRS), PC_SPI_TMPSEL);
+#endif
 }
 
 
@@ -184,9 +208,13 @@ spiPostTempSensorRead(SPI_CB *cb)
 
 	pi = (unsigned int *) cmd->SPI_ARG_PARM0;
 	*pi = (((unsigned int) t & 0x0fff) >> 3) - 130;
+	cb->Value = *pi;
+
+	if (spiValueHook)
+		(*spiValueHook)(SPI_KEY(SPI_KEY_TEMPSENSOR, 0, 0), cb->Value);
 
 	SPIDEBUG(("spiPostTempSensorRead: t=%x pi=%x *pi=%d\n", (unsigned int) t,
-		(unsigned int) pi, (unsigned int) *pi, 0, 0, 0));
+		pi, (unsigned int) *pi, 0, 0, 0));
 
 	/*
 	// -----------------------------------------------------------
@@ -251,6 +279,41 @@ spiPreTempSensorRead(SPI_CB *cb)
 }
 
 
+/*
+// ---------------------------------------------------------------
+// Function: spiTempSensorFormat
+//
+// Purpose: format the command block for a temperature read.
+//
+// Description: The temperature in celsius is stored in
+//		*piCelsius.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+void
+spiTempSensorFormat(SPI_CMD *cmd, int *piCelsius)
+{
+	memset((char *) cmd, 0, sizeof (SPI_CMD));
+
+	cmd->Mode = SPICB_MODE_TEMPSENSOR;
+	cmd->TxSize = cmd->RxSize = 8;
+	cmd->Flags = SPI_CMD_CHAIN;
+	cmd->Cs = SPI_CS_TEMPSENSOR;
+	cmd->SPI_ARG_PARM0 = (SPI_ARG) piCelsius;
+	cmd->Ops = &spiTempSensorOps;
+}
+
+
 /*
 // ---------------------------------------------------------------
 // Function: spiTempSensorRead
@@ -274,9 +337,65 @@ spiPreTempSensorRead(SPI_CB *cb)
 int
 spiTempSensorRead(int *piCelsius)
 {
-	int id;
+	return spiTempSensorReadCB(ERROR, piCelsius);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiTempSensorReadSession
+//
+// Purpose: read the temperature on a control block the caller keeps.
+//
+// Description: Same as spiTempSensorRead(), but the read runs on
+//		Session, a control block from spiAllocate() that the
+//		caller holds across reads.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: as spiTempSensorRead().
+//
+// Exception:
+//
+// Concurrency: One read at a time per session.
+//
+// ---------------------------------------------------------------
+*/
+int
+spiTempSensorReadSession(int Session, int *piCelsius)
+{
+	return spiTempSensorReadCB(Session, piCelsius);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: spiTempSensorReadCB
+//
+// Purpose: read the temperature.
+//
+// Description: With Session ERROR a control block is allocated
+//		for the read and freed after it.
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+spiTempSensorReadCB(int Session, int *piCelsius)
+{
+	int id = Session;
 	int ret;
-	SPI_CMD *pcmd;
 	SPI_CMD cmd[1];
 
 	/*
@@ -285,23 +404,25 @@ spiTempSensorRead(int *piCelsius)
 	// -----------------------------------------------------------
 	*/
 
-	pcmd = cmd + 0;
-	pcmd->Mode = SPICB_MODE_TEMPSENSOR;
-	pcmd->SPI_ARG_PARM0 = (unsigned int) piCelsius;
-	pcmd->CsOff = (FUNCPTR) spiCsOffTempSensor;
-	pcmd->CsOn = (FUNCPTR) spiCsOnTempSensor;
-	pcmd->PostOp = (FUNCPTR) spiPostTempSensorRead;
-	pcmd->PreOp = (FUNCPTR) spiPreTempSensorRead;
+	spiTempSensorFormat(cmd, piCelsius);
 
 	/*
 	// -----------------------------------------------------------
-	// allocate control block.
+	// allocate control block unless the caller brought one.
 	// -----------------------------------------------------------
 	*/
 
-	if ((id = spiAllocate()) == ERROR)
+	if ((Session == ERROR) && ((id = spiAllocate()) == ERROR))
 		return ERROR;
 
+	/*
+	// -----------------------------------------------------------
+	// concurrent reads share one transfer.
+	// -----------------------------------------------------------
+	*/
+
+	spiSetKey(id, SPI_KEY(SPI_KEY_TEMPSENSOR, 0, 0));
+
 	/*
 	// -----------------------------------------------------------
 	// schedule command block(s).
@@ -309,8 +430,12 @@ spiTempSensorRead(int *piCelsius)
 	*/
 
 	if (spiSched(id,
-		cmd, (sizeof(cmd)/sizeof(cmd)[0]), SPI_SYNC, 0L) == ERROR)
+		cmd, (sizeof(cmd)/sizeof(cmd)[0]), SPI_SYNC, 0L) == ERROR) {
+
+		if (Session == ERROR)
+			spiFree(id);
 		return ERROR;
+	}
 
 	/*
 	// -----------------------------------------------------------
@@ -331,11 +456,21 @@ spiTempSensorRead(int *piCelsius)
 
 	/*
 	// -----------------------------------------------------------
-	// free control block.
+	// a read that joined another one gets its result here.
+	// -----------------------------------------------------------
+	*/
+
+	if (ret == 0)
+		*piCelsius = SpiCB[id].Value;
+
+	/*
+	// -----------------------------------------------------------
+	// free control block, a session keeps it.
 	// -----------------------------------------------------------
 	*/
 
-	spiFree(id);
+	if (Session == ERROR)
+		spiFree(id);
 
 	/*
 	// -----------------------------------------------------------
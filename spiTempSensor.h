@@ -30,6 +30,9 @@ extern "C" {
 
 #define SPICB_MODE_TEMPSENSOR		0x0f70
 
+#define SPI_KEY_TEMPSENSOR			2	/* single-flight device id */
+#define SPI_CS_TEMPSENSOR			0x80	/* chip select identity */
+
 
 /*
 // ---------------------------------------------------------------
@@ -71,14 +74,18 @@ extern void spiCsOnTempSensor(void);
 extern void spiCsOffTempSensor(void);
 extern int spiPostTempSensorRead(SPI_CB *cb);
 extern int spiPreTempSensorRead(SPI_CB *cb);
+extern void spiTempSensorFormat(SPI_CMD *cmd, int *piCelsius);
 extern int spiTempSensorRead(int *piCelsius);
+extern int spiTempSensorReadSession(int Session, int *piCelsius);
 #else
 extern void spiTempSensorInit();
 extern void spiCsOnTempSensor();
 extern void spiCsOffTempSensor();
 extern int spiPostTempSensorRead();
 extern int spiPreTempSensorRead();
+extern void spiTempSensorFormat();
 extern int spiTempSensorRead();
+extern int spiTempSensorReadSession();
 #endif	/* __STDC__ */
 
 
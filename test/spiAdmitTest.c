@@ -0,0 +1,386 @@
+/*
+// ---------------------------------------------------------------
+// File: spiAdmitTest.c
+//
+// Module: SPI deadline admission stress test.
+//
+// Description: Many tasks submit deadline reads at the same
+//		moment while the bus is held up, and the test checks
+//		that the reads admitted fit before the deadline
+//		together, not just each on its own.  A submitter that
+//		checked the queue before another one had added to it
+//		would overbook the bus.  Every admitted read must then
+//		complete with its own channel's value.
+//
+// Operation: The fake spidev ioctl blocks the first message of a
+//		round on a gate, so the queue stands still while the
+//		submitters race.  The gate opens once all of them are
+//		either refused or waiting in spiSync().
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "string.h"
+#include "semLib.h"
+#include "taskLib.h"
+#include "tickLib.h"
+#include "sysLib.h"
+#include "spiLib.h"
+#include "spiLtc1598.h"
+#include "spiSpidev.h"
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define FAKE_FD			100
+#define FAKE_CS			1
+#define FAKE_VALUE(ch)	(0x100 * (ch) + 0x23)
+
+#define TEST_ROUNDS		50
+#define TEST_TASKS		(SPI_MAX_CB - 1)	/* one block is the blocker */
+#define TEST_BUDGET		6					/* ticks to the deadline */
+
+#define TEST_TICKS(work)	(((((work) + 999) / 1000) * sysClkRateGet() + \
+	999) / 1000)
+
+#define CHECK(cond)	{ \
+	if (!(cond)) { \
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		++testFailed; \
+	} \
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int testFailed = 0;
+LOCAL int fakeChannel = 0;			/* channel last selected */
+LOCAL volatile BOOL fakeHold = FALSE;	/* block the next message */
+LOCAL SEM_ID fakeEntered;			/* given when a message blocks */
+LOCAL SEM_ID fakeGate;				/* given to let it through */
+
+LOCAL SEM_ID testStart[TEST_TASKS];	/* one per submitter */
+LOCAL SEM_ID testDone;				/* given by each submitter */
+LOCAL SEM_ID testBlocked;			/* given by the blocker */
+LOCAL volatile int testDeadline;
+LOCAL volatile int testAdmitted;
+LOCAL volatile int testRefused;
+LOCAL volatile int testWork;		/* usec of one read */
+LOCAL int testValue[TEST_TASKS];
+LOCAL int testResult[TEST_TASKS];
+LOCAL int testBlockValue;
+LOCAL int testBlockResult;
+
+
+/*
+// ---------------------------------------------------------------
+// Function: fakeIoctl
+//
+// Purpose: stand in for the spidev ioctls.
+//
+// Description: While fakeHold is set, the next message waits for
+//		fakeGate.
+//
+// Architecture:
+//
+// Relationship: Installed as spiSpidevIoctl.
+//
+// Returns: The bytes transferred, or 0 for SPI_IOC_WR_MODE.
+//
+// Exception:
+//
+// Concurrency: spidev transfer task.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+fakeIoctl(int fd, unsigned long request, void *arg)
+{
+	struct spi_ioc_transfer *x = (struct spi_ioc_transfer *) arg;
+	UINT8 *tx;
+	UINT8 *rx;
+	int total = 0;
+	int n;
+	int k;
+
+	if (request == SPI_IOC_WR_MODE)
+		return 0;
+
+	if (fakeHold) {
+		fakeHold = FALSE;
+		semGive(fakeEntered);
+		semTake(fakeGate, WAIT_FOREVER);
+	}
+
+	n = _IOC_SIZE(request) / sizeof (*x);
+
+	for (k = 0; k < n; ++k) {
+
+		tx = (UINT8 *) (unsigned long) x[k].tx_buf;
+		rx = (UINT8 *) (unsigned long) x[k].rx_buf;
+
+		if ((x[k].len == 1) && (tx[0] & 0x08)) {
+			fakeChannel = tx[0] & 0x07;
+			rx[0] = 0;
+		} else if (x[k].len == 2) {
+			rx[0] = (UINT8) ((FAKE_VALUE(fakeChannel) << 1) >> 8);
+			rx[1] = (UINT8) (FAKE_VALUE(fakeChannel) << 1);
+		}
+
+		total += x[k].len;
+	}
+
+	return total;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: testSubmitter
+//
+// Purpose: submit one deadline read per round.
+//
+// Description: Reads channel i % SPI_LTC1598_CHANNELS on a control
+//		block of its own.
+//
+// Architecture:
+//
+// Relationship: Spawned by main().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: TEST_TASKS of these at once.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+testSubmitter(int i)
+{
+	int id;
+	int ch = i % SPI_LTC1598_CHANNELS;
+	SPI_CMD cmd[2];
+
+	id = spiAllocate();
+
+	for (;;) {
+
+		semTake(testStart[i], WAIT_FOREVER);
+
+		testValue[i] = -1;
+		spiLtc1598Format(cmd, FAKE_CS, ch, testValue + i);
+		spiSetPreempt(id, FALSE);
+
+		if (spiSchedDeadline(id, cmd, 2, SPI_SYNC, NULL, testDeadline) ==
+			ERROR) {
+			testResult[i] = ERROR;
+			__atomic_add_fetch(&testRefused, 1, __ATOMIC_SEQ_CST);
+			semGive(testDone);
+			continue;
+		}
+
+		testWork = SpiCB[id].Work;
+		__atomic_add_fetch(&testAdmitted, 1, __ATOMIC_SEQ_CST);
+		semGive(testDone);
+
+		testResult[i] = spiSync(id, WAIT_FOREVER);
+		semGive(testDone);
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: testBlocker
+//
+// Purpose: hold the bus for a round.
+//
+// Description: Reads channel 0 with no deadline; fakeIoctl() keeps
+//		the message until the gate opens.  Its control block is
+//		free again before testBlocked is given, so the next
+//		round can allocate one.
+//
+// Architecture:
+//
+// Relationship: Spawned by main() once per round.
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+testBlocker(void)
+{
+	testBlockValue = -1;
+	testBlockResult = spiLtc1598Read(FAKE_CS, 0, &testBlockValue);
+
+	semGive(testBlocked);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: main
+//
+// Purpose: run the rounds.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: 0 if every check passed, 1 otherwise.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+main(void)
+{
+	int round;
+	int i;
+	int t0;
+	int run;
+	int admitted = 0;
+	int refused = 0;
+
+	fakeEntered = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+	fakeGate = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+	testDone = semCCreate(SEM_Q_FIFO, 0);
+	testBlocked = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+
+	for (i = 0; i < TEST_TASKS; ++i)
+		testStart[i] = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+
+	if ((spiInit() == ERROR) ||
+		(spiSpidevAttach(FAKE_CS, FAKE_FD) == ERROR)) {
+		printf("FAIL spiInit\n");
+		return 1;
+	}
+
+	spiLtc1598Init();
+	spiSpidevIoctl = fakeIoctl;
+
+	for (i = 0; i < TEST_TASKS; ++i)
+		taskSpawn("tTestSub", 100, 0, 8000, (FUNCPTR) testSubmitter,
+			i, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	taskDelay(10);
+
+	for (round = 0; round < TEST_ROUNDS; ++round) {
+
+		/*
+		// -------------------------------------------------------
+		// hold the bus with a read of our own.
+		// -------------------------------------------------------
+		*/
+
+		fakeHold = TRUE;
+
+		if (taskSpawn("tTestBlk", 100, 0, 8000, (FUNCPTR) testBlocker,
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0) == ERROR) {
+			printf("FAIL taskSpawn\n");
+			return 1;
+		}
+
+		semTake(fakeEntered, WAIT_FOREVER);
+
+		run = SpiHdr.RunCB ? SpiHdr.RunCB->Work : 0;
+
+		/*
+		// -------------------------------------------------------
+		// release the submitters together.
+		// -------------------------------------------------------
+		*/
+
+		testAdmitted = 0;
+		testRefused = 0;
+
+		t0 = (int) tickGet();
+		testDeadline = t0 + TEST_BUDGET;
+
+		for (i = 0; i < TEST_TASKS; ++i)
+			semGive(testStart[i]);
+
+		for (i = 0; i < TEST_TASKS; ++i)
+			semTake(testDone, WAIT_FOREVER);
+
+		/*
+		// -------------------------------------------------------
+		// the reads admitted must fit together.
+		// -------------------------------------------------------
+		*/
+
+		CHECK(testAdmitted + testRefused == TEST_TASKS);
+		CHECK(TEST_TICKS(testAdmitted * testWork + run) <= TEST_BUDGET);
+
+		admitted += testAdmitted;
+		refused += testRefused;
+
+		/*
+		// -------------------------------------------------------
+		// let them run and check what they read.
+		// -------------------------------------------------------
+		*/
+
+		semGive(fakeGate);
+
+		for (i = 0; i < testAdmitted; ++i)
+			semTake(testDone, WAIT_FOREVER);
+
+		semTake(testBlocked, WAIT_FOREVER);
+
+		CHECK(testBlockResult == OK);
+		CHECK(testBlockValue == FAKE_VALUE(0));
+
+		for (i = 0; i < TEST_TASKS; ++i)
+			if (testResult[i] != ERROR) {
+				CHECK(testResult[i] == OK);
+				CHECK(testValue[i] ==
+					FAKE_VALUE(i % SPI_LTC1598_CHANNELS));
+			}
+
+		while (SpiHdr.State != SPIDEV_STATE_IDLE)
+			taskDelay(1);
+	}
+
+	CHECK(admitted > 0);
+	CHECK(refused > 0);
+
+	printf("%s: %s (%d admitted, %d refused)\n", __FILE__,
+		testFailed ? "FAILED" : "ok", admitted, refused);
+
+	return testFailed ? 1 : 0;
+}
@@ -0,0 +1,283 @@
+/*
+// ---------------------------------------------------------------
+// File: spiCoroTest.cpp
+//
+// Module: SPI C++20 coroutine interface test.
+//
+// Description: Runs spi::Executor coroutines over the spidev
+//		backend and a fake ioctl.  Two sessions read the LTC1598
+//		channels at once, and the values they decode are read
+//		back through the Data member of the awaiter, which lives
+//		in the coroutine frame on the heap.  A raw transaction
+//		after a device read must find its control block
+//		preemptible and without a key again.
+//
+// Operation: The fake LTC1598 on FAKE_FD remembers the channel
+//		last selected and answers every conversion with
+//		FAKE_VALUE() of it.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "string.h"
+#include "spiLib.h"
+#include "spiLtc1598.h"
+#include "spiSpidev.h"
+#include "spiCoro.h"
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define FAKE_FD			100
+#define FAKE_CS			1
+#define FAKE_VALUE(ch)	(0x100 * (ch) + 0x23)
+
+#define CHECK(cond)	{ \
+	if (!(cond)) { \
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		++testFailed; \
+	} \
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int testFailed = 0;
+LOCAL int testReads = 0;			/* device reads completed */
+LOCAL int fakeChannel = 0;			/* channel last selected */
+LOCAL int fakeMessages = 0;			/* SPI_IOC_MESSAGE calls */
+
+
+/*
+// ---------------------------------------------------------------
+// Function: fakeIoctl
+//
+// Purpose: stand in for the spidev ioctls.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: Installed as spiSpidevIoctl.
+//
+// Returns: The bytes transferred, 0 for SPI_IOC_WR_MODE, or -1
+//		with errno set.
+//
+// Exception:
+//
+// Concurrency: spidev transfer task.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+fakeIoctl(int fd, unsigned long request, void *arg)
+{
+	struct spi_ioc_transfer *x = (struct spi_ioc_transfer *) arg;
+	UINT8 *tx;
+	UINT8 *rx;
+	int total = 0;
+	int n;
+	int k;
+
+	if (fd != FAKE_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (request == SPI_IOC_WR_MODE)
+		return 0;
+
+	n = _IOC_SIZE(request) / sizeof (*x);
+
+	fakeMessages++;
+
+	for (k = 0; k < n; ++k) {
+
+		tx = (UINT8 *) (unsigned long) x[k].tx_buf;
+		rx = (UINT8 *) (unsigned long) x[k].rx_buf;
+
+		if ((x[k].len == 1) && (tx[0] & 0x08)) {
+			fakeChannel = tx[0] & 0x07;
+			rx[0] = 0;
+		} else if (x[k].len == 2) {
+			rx[0] = (UINT8) ((FAKE_VALUE(fakeChannel) << 1) >> 8);
+			rx[1] = (UINT8) (FAKE_VALUE(fakeChannel) << 1);
+		}
+
+		total += x[k].len;
+	}
+
+	return total;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: testPoll
+//
+// Purpose: read every LTC1598 channel on one session.
+//
+// Description: Starts at channel first, so that two sessions
+//		interleave different channels on the bus.
+//
+// Architecture:
+//
+// Relationship: Spawned on the executor by main().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Executor task.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL spi::Task
+testPoll(spi::Session &s, int first)
+{
+	int k;
+	int ch;
+
+	for (k = 0; k < SPI_LTC1598_CHANNELS; ++k) {
+
+		ch = (first + k) % SPI_LTC1598_CHANNELS;
+
+		spi::Result r = co_await s.ltc1598(FAKE_CS, ch);
+
+		CHECK(r.Error == 0);
+		CHECK(r.Value == FAKE_VALUE(ch));
+
+		++testReads;
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: testRaw
+//
+// Purpose: follow a device read with a raw transaction.
+//
+// Description: The raw transaction sends one byte that selects no
+//		channel.  The LTC1598 read leaves its control block
+//		non-preemptible with the channel's key; the raw one must
+//		clear both.
+//
+// Architecture:
+//
+// Relationship: Spawned on the executor by main().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency: Executor task.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL spi::Task
+testRaw(spi::Session &s)
+{
+	static UINT8 tx;
+	static UINT8 rx;
+	static SPI_CMD cmd;
+
+	spi::Result r = co_await s.ltc1598(FAKE_CS, 3);
+
+	CHECK(r.Error == 0);
+	CHECK(r.Value == FAKE_VALUE(3));
+	CHECK(SpiCB[s.id()].Flags & SPICB_FLAG_NOPREEMPT);
+	CHECK(SpiCB[s.id()].Key != 0);
+
+	memset((char *) &cmd, 0, sizeof (cmd));
+	cmd.Mode = SPICB_MODE_LTC1598;
+	cmd.TxBuf = (char *) &tx;
+	cmd.RxBuf = (char *) &rx;
+	cmd.TxSize = cmd.RxSize = 1;
+	cmd.Cs = FAKE_CS;
+
+	r = co_await s.transact(&cmd, 1);
+
+	CHECK(r.Error == 0);
+	CHECK((SpiCB[s.id()].Flags & SPICB_FLAG_NOPREEMPT) == 0);
+	CHECK(SpiCB[s.id()].Key == 0);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: main
+//
+// Purpose: run the tests.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: 0 if every check passed, 1 otherwise.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+main(void)
+{
+	if ((spiInit() == ERROR) ||
+		(spiSpidevAttach(FAKE_CS, FAKE_FD) == ERROR)) {
+		printf("FAIL spiInit\n");
+		return 1;
+	}
+
+	spiLtc1598Init();
+	spiSpidevIoctl = fakeIoctl;
+
+	{
+		spi::Executor ex;
+		spi::Session a(ex);
+		spi::Session b(ex);
+
+		CHECK(a.valid() && b.valid());
+
+		ex.spawn(testPoll(a, 0));
+		ex.spawn(testPoll(b, 4));
+		ex.run();
+
+		CHECK(testReads == 2 * SPI_LTC1598_CHANNELS);
+		CHECK(fakeMessages == 2 * SPI_LTC1598_CHANNELS);
+
+		ex.spawn(testRaw(a));
+		ex.run();
+	}
+
+	printf("%s: %s\n", __FILE__, testFailed ? "FAILED" : "ok");
+
+	return testFailed ? 1 : 0;
+}
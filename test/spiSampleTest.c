@@ -0,0 +1,267 @@
+/*
+// ---------------------------------------------------------------
+// File: spiSampleTest.c
+//
+// Module: SPI periodic sampling test.
+//
+// Description: Cancels a sampling round while it waits on the run
+//		queue.  A cancelled round is never notified, and the
+//		sampler must still go on to the next round, and stop
+//		when asked.
+//
+// Operation: The fake spidev ioctl holds the message that selects
+//		channel 0 on a gate, so a read of channel 0 keeps the
+//		bus while the sampler, on channel 2, queues behind it.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "string.h"
+#include "semLib.h"
+#include "taskLib.h"
+#include "spiLib.h"
+#include "spiLtc1598.h"
+#include "spiSample.h"
+#include "spiSpidev.h"
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define FAKE_FD			100
+#define FAKE_CS			1
+#define FAKE_VALUE(ch)	(0x100 * (ch) + 0x23)
+
+#define TEST_CHANNEL	2		/* sampled channel */
+
+#define CHECK(cond)	{ \
+	if (!(cond)) { \
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		++testFailed; \
+	} \
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int testFailed = 0;
+LOCAL int fakeChannel = 0;			/* channel last selected */
+LOCAL volatile BOOL fakeHold = FALSE;	/* hold the next channel 0 read */
+LOCAL SEM_ID fakeEntered;			/* given when a message is held */
+LOCAL SEM_ID fakeGate;				/* given to let it through */
+
+LOCAL SEM_ID testBlocked;			/* given by the blocker */
+LOCAL int testBlockValue;
+LOCAL int testBlockResult;
+
+
+/*
+// ---------------------------------------------------------------
+// Function: fakeIoctl
+//
+// Purpose: stand in for the spidev ioctls.
+//
+// Description: While fakeHold is set, the next message selecting
+//		channel 0 waits for fakeGate.
+//
+// Architecture:
+//
+// Relationship: Installed as spiSpidevIoctl.
+//
+// Returns: The bytes transferred, or 0 for SPI_IOC_WR_MODE.
+//
+// Exception:
+//
+// Concurrency: spidev transfer task.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+fakeIoctl(int fd, unsigned long request, void *arg)
+{
+	struct spi_ioc_transfer *x = (struct spi_ioc_transfer *) arg;
+	UINT8 *tx;
+	UINT8 *rx;
+	int total = 0;
+	int n;
+	int k;
+
+	if (request == SPI_IOC_WR_MODE)
+		return 0;
+
+	n = _IOC_SIZE(request) / sizeof (*x);
+
+	for (k = 0; k < n; ++k) {
+
+		tx = (UINT8 *) (unsigned long) x[k].tx_buf;
+		rx = (UINT8 *) (unsigned long) x[k].rx_buf;
+
+		if ((x[k].len == 1) && (tx[0] & 0x08)) {
+			fakeChannel = tx[0] & 0x07;
+			rx[0] = 0;
+			if (fakeHold && (fakeChannel == 0)) {
+				fakeHold = FALSE;
+				semGive(fakeEntered);
+				semTake(fakeGate, WAIT_FOREVER);
+			}
+		} else if (x[k].len == 2) {
+			rx[0] = (UINT8) ((FAKE_VALUE(fakeChannel) << 1) >> 8);
+			rx[1] = (UINT8) (FAKE_VALUE(fakeChannel) << 1);
+		}
+
+		total += x[k].len;
+	}
+
+	return total;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: testBlocker
+//
+// Purpose: hold the bus with a read of channel 0.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: Spawned by main().
+//
+// Returns:
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+LOCAL void
+testBlocker(void)
+{
+	testBlockValue = -1;
+	testBlockResult = spiLtc1598Read(FAKE_CS, 0, &testBlockValue);
+
+	semGive(testBlocked);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: main
+//
+// Purpose: run the test.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: 0 if every check passed, 1 otherwise.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+main(void)
+{
+	int i;
+	int round;
+	SPI_CB *cb = 0L;
+	SPI_SAMPLE_SNAP snap;
+	SPI_SAMPLE_ENTRY entry;
+
+	fakeEntered = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+	fakeGate = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+	testBlocked = semBCreate(SEM_Q_FIFO, SEM_EMPTY);
+
+	if ((spiInit() == ERROR) ||
+		(spiSpidevAttach(FAKE_CS, FAKE_FD) == ERROR)) {
+		printf("FAIL spiInit\n");
+		return 1;
+	}
+
+	spiLtc1598Init();
+	spiSpidevIoctl = fakeIoctl;
+
+	memset((char *) &entry, 0, sizeof (entry));
+	entry.Device = SPI_SAMPLE_LTC1598;
+	entry.Cs = FAKE_CS;
+	entry.Channel = TEST_CHANNEL;
+	entry.Period = 1;
+
+	CHECK(spiSampleStart(&entry, 1) == OK);
+	CHECK(spiSampleWait(&snap, 1000) == OK);
+	CHECK(snap.Value[0] == FAKE_VALUE(TEST_CHANNEL));
+
+	/*
+	// -----------------------------------------------------------
+	// hold the bus, and cancel the round queued behind it.
+	// -----------------------------------------------------------
+	*/
+
+	fakeHold = TRUE;
+
+	taskSpawn("tTestBlk", 100, 0, 8000, (FUNCPTR) testBlocker,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	semTake(fakeEntered, WAIT_FOREVER);
+
+	for (i = 0; (i < 1000) && ((cb = SpiHdr.CBHead) == 0L); ++i)
+		taskDelay(1);
+
+	CHECK(cb != 0L);
+
+	if (cb)
+		CHECK(spiCancel(cb->Id) == OK);
+
+	round = snap.Round;
+
+	semGive(fakeGate);
+	semTake(testBlocked, WAIT_FOREVER);
+
+	CHECK(testBlockResult == OK);
+	CHECK(testBlockValue == FAKE_VALUE(0));
+
+	/*
+	// -----------------------------------------------------------
+	// sampling goes on, and stops.
+	// -----------------------------------------------------------
+	*/
+
+	CHECK(spiSampleWait(&snap, 1000) == OK);
+	CHECK(snap.Round > round);
+	CHECK(snap.Value[0] == FAKE_VALUE(TEST_CHANNEL));
+
+	CHECK(spiSampleStop() == OK);
+
+	printf("%s: %s\n", __FILE__, testFailed ? "FAILED" : "ok");
+
+	return testFailed ? 1 : 0;
+}
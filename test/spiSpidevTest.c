@@ -0,0 +1,258 @@
+/*
+// ---------------------------------------------------------------
+// File: spiSpidevTest.c
+//
+// Module: SPI Linux spidev backend test.
+//
+// Description: Runs the LTC1598 driver through spiLib and the
+//		spidev backend against a fake ioctl, and checks the
+//		messages it sends and the values it decodes.  The
+//		results are written through pointers on the stack, which
+//		on an LP64 host lie above 4 GB.
+//
+// Operation: The fake LTC1598 on FAKE_FD remembers the channel
+//		last selected and answers every conversion with
+//		FAKE_VALUE() of it, one LSB low and high in turn.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#include "vxWorks.h"
+#include "stdio.h"
+#include "string.h"
+#include "tickLib.h"
+#include "spiLib.h"
+#include "spiLtc1598.h"
+#include "spiSpidev.h"
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define FAKE_FD			100
+#define FAKE_CS			1
+#define FAKE_VALUE(ch)	(0x100 * (ch) + 0x23)
+
+#define CHECK(cond)	{ \
+	if (!(cond)) { \
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		++testFailed; \
+	} \
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL int testFailed = 0;
+LOCAL int fakeChannel = 0;			/* channel last selected */
+LOCAL int fakeSamples = 0;			/* conversions answered */
+LOCAL int fakeMessages = 0;			/* SPI_IOC_MESSAGE calls */
+LOCAL int fakeModes = 0;			/* SPI_IOC_WR_MODE calls */
+LOCAL int fakeXfers = 0;			/* transfers in the last message */
+LOCAL int fakeCsChange[SPI_SPIDEV_MAX_XFER];
+
+
+/*
+// ---------------------------------------------------------------
+// Function: fakeIoctl
+//
+// Purpose: stand in for the spidev ioctls.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship: Installed as spiSpidevIoctl.
+//
+// Returns: The bytes transferred, 0 for SPI_IOC_WR_MODE, or -1
+//		with errno set.
+//
+// Exception:
+//
+// Concurrency: spidev transfer task.
+//
+// ---------------------------------------------------------------
+*/
+LOCAL int
+fakeIoctl(int fd, unsigned long request, void *arg)
+{
+	struct spi_ioc_transfer *x = (struct spi_ioc_transfer *) arg;
+	UINT8 *tx;
+	UINT8 *rx;
+	int total = 0;
+	int n;
+	int k;
+	int v;
+
+	if (fd != FAKE_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (request == SPI_IOC_WR_MODE) {
+		fakeModes++;
+		return 0;
+	}
+
+	if ((_IOC_TYPE(request) != SPI_IOC_MAGIC) || (_IOC_NR(request) != 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	n = _IOC_SIZE(request) / sizeof (*x);
+
+	fakeMessages++;
+	fakeXfers = n;
+
+	for (k = 0; k < n; ++k) {
+
+		tx = (UINT8 *) (unsigned long) x[k].tx_buf;
+		rx = (UINT8 *) (unsigned long) x[k].rx_buf;
+
+		fakeCsChange[k] = x[k].cs_change;
+
+		if ((x[k].len == 1) && (tx[0] & 0x08)) {
+			fakeChannel = tx[0] & 0x07;
+			rx[0] = 0;
+		} else if (x[k].len == 2) {
+			v = FAKE_VALUE(fakeChannel) + ((fakeSamples++ & 1) ? 1 : -1);
+			rx[0] = (UINT8) ((v << 1) >> 8);
+			rx[1] = (UINT8) (v << 1);
+		}
+
+		total += x[k].len;
+	}
+
+	return total;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Function: main
+//
+// Purpose: run the tests.
+//
+// Description:
+//
+// Architecture:
+//
+// Relationship:
+//
+// Returns: 0 if every check passed, 1 otherwise.
+//
+// Exception:
+//
+// Concurrency:
+//
+// ---------------------------------------------------------------
+*/
+int
+main(void)
+{
+	int ch;
+	int data;
+	int min;
+	int max;
+	int msgs;
+	int t0;
+
+	if ((spiInit() == ERROR) ||
+		(spiSpidevAttach(FAKE_CS, FAKE_FD) == ERROR)) {
+		printf("FAIL spiInit\n");
+		return 1;
+	}
+
+	spiLtc1598Init();
+	spiSpidevIoctl = fakeIoctl;
+
+	/*
+	// -----------------------------------------------------------
+	// a read is one message: channel select, then conversion.
+	// -----------------------------------------------------------
+	*/
+
+	for (ch = 0; ch < SPI_LTC1598_CHANNELS; ++ch) {
+
+		msgs = fakeMessages;
+		data = -1;
+
+		CHECK(spiLtc1598Read(FAKE_CS, ch, &data) == OK);
+		CHECK((data == FAKE_VALUE(ch) - 1) || (data == FAKE_VALUE(ch) + 1));
+		CHECK(fakeMessages == msgs + 1);
+		CHECK(fakeXfers == 2);
+		CHECK((fakeCsChange[0] == 1) && (fakeCsChange[1] == 0));
+	}
+
+	CHECK(fakeModes == 1);
+
+	/*
+	// -----------------------------------------------------------
+	// oversampling averages out the +-1 LSB.
+	// -----------------------------------------------------------
+	*/
+
+	fakeSamples = 0;
+
+	CHECK(spiLtc1598ReadOversample(FAKE_CS, 5, 4, SPI_LTC1598_AVERAGE,
+		&data, &min, &max) == OK);
+	CHECK(data == FAKE_VALUE(5));
+	CHECK((min == FAKE_VALUE(5) - 1) && (max == FAKE_VALUE(5) + 1));
+
+	/*
+	// -----------------------------------------------------------
+	// a merged read on an idle bus does not wait out the window,
+	// and keeps the chip select between its commands.
+	// -----------------------------------------------------------
+	*/
+
+	CHECK(spiLtc1598Merge(1000) == OK);
+
+	msgs = fakeMessages;
+	data = -1;
+	t0 = (int) tickGet();
+
+	CHECK(spiLtc1598Read(FAKE_CS, 3, &data) == OK);
+	CHECK((int) tickGet() - t0 < 100);
+	CHECK((data == FAKE_VALUE(3) - 1) || (data == FAKE_VALUE(3) + 1));
+	CHECK(fakeMessages == msgs + 1);
+	CHECK(fakeXfers == 2);
+	CHECK((fakeCsChange[0] == 0) && (fakeCsChange[1] == 0));
+
+	CHECK(spiLtc1598Merge(0) == OK);
+
+	/*
+	// -----------------------------------------------------------
+	// a chip select without a file fails the read.
+	// -----------------------------------------------------------
+	*/
+
+	msgs = fakeMessages;
+
+	CHECK(spiLtc1598Read(FAKE_CS + 1, 0, &data) == ENODEV);
+	CHECK(fakeMessages == msgs);
+
+	printf("%s: %s\n", __FILE__, testFailed ? "FAILED" : "ok");
+
+	return testFailed ? 1 : 0;
+}
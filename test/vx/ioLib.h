@@ -0,0 +1,5 @@
+/* ioLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
+#include <fcntl.h>
+#include <unistd.h>
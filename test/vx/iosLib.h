@@ -0,0 +1,3 @@
+/* iosLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
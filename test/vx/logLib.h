@@ -0,0 +1,3 @@
+/* logLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
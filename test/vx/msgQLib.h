@@ -0,0 +1,3 @@
+/* msgQLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
@@ -0,0 +1,3 @@
+/* semLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
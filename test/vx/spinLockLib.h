@@ -0,0 +1,3 @@
+/* spinLockLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
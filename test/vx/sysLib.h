@@ -0,0 +1,3 @@
+/* sysLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
@@ -0,0 +1,3 @@
+/* taskLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
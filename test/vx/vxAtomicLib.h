@@ -0,0 +1,3 @@
+/* vxAtomicLib.h - VxWorks shim for host builds, see vxWorks.h */
+
+#include "vxWorks.h"
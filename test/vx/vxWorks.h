@@ -0,0 +1,169 @@
+/*
+// ---------------------------------------------------------------
+// File: vxWorks.h
+//
+// Module: VxWorks shim for host builds.
+//
+// Description: The subset of the VxWorks kernel API that spiLib
+//		and the device drivers use, implemented on POSIX threads
+//		by vxShim.c, so that the SPI_SPIDEV build runs on a Linux
+//		host.  The other VxWorks headers in this directory only
+//		include this one.
+//
+// Operation: Build with _WRS_CONFIG_SMP: SPI_LOCK is then a
+//		spinlock, which the shim implements as an error checking
+//		mutex.  Taking it twice on one thread, or giving or
+//		taking a semaphore while holding it, aborts the program
+//		instead of hanging it.  A clock tick is 1 msec.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+#ifndef	VXWORKS_H
+#define	VXWORKS_H
+
+#include <stddef.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+// ---------------------------------------------------------------
+// Basic types and constants.
+// ---------------------------------------------------------------
+*/
+
+typedef int STATUS;
+typedef int BOOL;
+typedef unsigned char UINT8;
+typedef unsigned short UINT16;
+typedef unsigned int UINT32;
+typedef signed char INT8;
+typedef short INT16;
+typedef int INT32;
+typedef unsigned char UCHAR;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+typedef unsigned long ULONG;
+typedef long _Vx_usr_arg_t;
+
+typedef int (*FUNCPTR)();
+typedef void (*VOIDFUNCPTR)();
+
+#define OK				0
+#define ERROR			(-1)
+#define TRUE			1
+#define FALSE			0
+#define LOCAL			static
+#define IMPORT			extern
+#define WAIT_FOREVER	(-1)
+#define NO_WAIT			0
+
+#define S_objLib_OBJ_UNAVAILABLE	0x3d0002
+#define S_objLib_OBJ_TIMEOUT		0x3d0004
+
+
+/*
+// ---------------------------------------------------------------
+// Semaphores, tasks, watchdogs.
+// ---------------------------------------------------------------
+*/
+
+typedef struct vxShimSem *SEM_ID;
+typedef struct vxShimWd *WDOG_ID;
+typedef struct vxShimMsgQ *MSG_Q_ID;
+
+#define SEM_Q_FIFO			0x00
+#define SEM_Q_PRIORITY		0x01
+#define SEM_DELETE_SAFE		0x04
+#define SEM_INVERSION_SAFE	0x08
+#define SEM_EMPTY			0
+#define SEM_FULL			1
+
+#define VX_FP_TASK			0x0008
+
+
+/*
+// ---------------------------------------------------------------
+// SMP spinlock and atomics.
+// ---------------------------------------------------------------
+*/
+
+typedef struct {
+	pthread_mutex_t m;
+} spinlockIsr_t;
+
+typedef long atomicVal_t;
+typedef volatile atomicVal_t atomic_t;
+
+#define VX_MEM_BARRIER_R()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define VX_MEM_BARRIER_W()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define VX_MEM_BARRIER_RW()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+
+/*
+// ---------------------------------------------------------------
+// Function declarations.
+// ---------------------------------------------------------------
+*/
+
+extern SEM_ID semBCreate(int options, int initial);
+extern SEM_ID semCCreate(int options, int initial);
+extern SEM_ID semMCreate(int options);
+extern STATUS semDelete(SEM_ID sem);
+extern STATUS semFlush(SEM_ID sem);
+extern STATUS semGive(SEM_ID sem);
+extern STATUS semTake(SEM_ID sem, int timeout);
+
+extern int taskSpawn(char *name, int priority, int options, int stackSize,
+	FUNCPTR entry, _Vx_usr_arg_t a1, _Vx_usr_arg_t a2, _Vx_usr_arg_t a3,
+	_Vx_usr_arg_t a4, _Vx_usr_arg_t a5, _Vx_usr_arg_t a6, _Vx_usr_arg_t a7,
+	_Vx_usr_arg_t a8, _Vx_usr_arg_t a9, _Vx_usr_arg_t a10);
+extern STATUS taskDelay(int ticks);
+extern int taskIdSelf(void);
+extern STATUS taskIdVerify(int tid);
+
+extern WDOG_ID wdCreate(void);
+extern STATUS wdCancel(WDOG_ID wd);
+extern STATUS wdDelete(WDOG_ID wd);
+extern STATUS wdStart(WDOG_ID wd, int delay, FUNCPTR fn, _Vx_usr_arg_t arg);
+
+extern int intContext(void);
+extern int intLock(void);
+extern void intUnlock(int level);
+
+extern void spinLockIsrInit(spinlockIsr_t *lock, int flags);
+extern void spinLockIsrGive(spinlockIsr_t *lock);
+extern void spinLockIsrTake(spinlockIsr_t *lock);
+
+extern atomicVal_t vxAtomicSet(atomic_t *target, atomicVal_t value);
+extern BOOL vxAtomicCas(atomic_t *target, atomicVal_t oldValue,
+	atomicVal_t newValue);
+
+extern ULONG tickGet(void);
+extern int sysClkRateGet(void);
+extern UINT32 sysTimestamp(void);
+extern STATUS sysTimestampEnable(void);
+extern UINT32 sysTimestampFreq(void);
+extern UINT32 sysTimestampPeriod(void);
+
+extern int errnoGet(void);
+extern STATUS errnoSet(int error);
+
+extern int logMsg(char *fmt, ...);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* VXWORKS_H */
@@ -0,0 +1,722 @@
+/*
+// ---------------------------------------------------------------
+// File: vxShim.c
+//
+// Module: VxWorks shim for host builds.
+//
+// Description: POSIX threads implementation of the calls declared
+//		in vx/vxWorks.h.
+//
+// Operation: Tasks are detached threads; task priorities and
+//		options are ignored.  Each watchdog has a thread of its
+//		own that calls the routine with intContext() true.
+//		intLock() is one recursive mutex for the whole program.
+//		The spinlock checks that it is never taken twice by the
+//		same thread and that no semaphore is used under it.
+//
+// Version:
+//
+// History:
+//
+// ---------------------------------------------------------------
+*/
+
+
+/*
+// ---------------------------------------------------------------
+// Header files.
+// ---------------------------------------------------------------
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "vxWorks.h"
+
+
+/*
+// ---------------------------------------------------------------
+// Miscellanous definitions.
+// ---------------------------------------------------------------
+*/
+
+#define VXSHIM_CLK_RATE		1000	/* ticks per second */
+#define VXSHIM_MAX_TASKS	64
+
+#define VXSHIM_SEM_BINARY	0
+#define VXSHIM_SEM_COUNTING	1
+#define VXSHIM_SEM_MUTEX	2
+
+#define VXSHIM_FATAL(what)	{ \
+	fprintf(stderr, "vxShim: %s\n", (what)); \
+	abort(); \
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Type definitions.
+// ---------------------------------------------------------------
+*/
+
+struct vxShimSem {
+	pthread_mutex_t m;
+	pthread_cond_t c;
+	int Kind;
+	int Count;				/* binary and counting */
+	unsigned int Flushes;	/* semFlush() calls, to release waiters */
+	pthread_t Owner;		/* mutex */
+	int Depth;				/* mutex, 0 if free */
+};
+
+struct vxShimWd {
+	pthread_mutex_t m;
+	pthread_cond_t c;
+	pthread_t Thread;
+	int Armed;
+	unsigned int Gen;		/* wdStart()/wdCancel() calls */
+	ULONG Due;
+	FUNCPTR Fn;
+	_Vx_usr_arg_t Arg;
+};
+
+typedef struct {
+	int Used;
+	volatile int Alive;
+	FUNCPTR Entry;
+	_Vx_usr_arg_t Arg[10];
+} VXSHIM_TASK;
+
+
+/*
+// ---------------------------------------------------------------
+// Local variables.
+// ---------------------------------------------------------------
+*/
+
+LOCAL pthread_mutex_t vxShimTaskLock = PTHREAD_MUTEX_INITIALIZER;
+LOCAL VXSHIM_TASK vxShimTask[VXSHIM_MAX_TASKS];
+LOCAL pthread_mutex_t vxShimIntLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+LOCAL struct timespec vxShimEpoch;
+LOCAL pthread_once_t vxShimOnce = PTHREAD_ONCE_INIT;
+
+LOCAL __thread int vxShimTid = 0;		/* task id of this thread */
+LOCAL __thread int vxShimInt = 0;		/* in a watchdog routine */
+LOCAL __thread int vxShimSpin = 0;		/* spinlocks held */
+
+
+/*
+// ---------------------------------------------------------------
+// Local function declarations.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void vxShimInit(void);
+LOCAL void vxShimDue(struct timespec *ts, int ticks);
+LOCAL void *vxShimTaskMain(void *arg);
+LOCAL void *vxShimWdMain(void *arg);
+LOCAL SEM_ID vxShimSemCreate(int kind, int count);
+
+
+/*
+// ---------------------------------------------------------------
+// Clock.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void
+vxShimInit(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &vxShimEpoch);
+}
+
+ULONG
+tickGet(void)
+{
+	struct timespec ts;
+
+	pthread_once(&vxShimOnce, vxShimInit);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ULONG) ((ts.tv_sec - vxShimEpoch.tv_sec) * VXSHIM_CLK_RATE +
+		(ts.tv_nsec - vxShimEpoch.tv_nsec) / (1000000000 / VXSHIM_CLK_RATE));
+}
+
+int
+sysClkRateGet(void)
+{
+	return VXSHIM_CLK_RATE;
+}
+
+UINT32
+sysTimestamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (UINT32) (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+STATUS
+sysTimestampEnable(void)
+{
+	return OK;
+}
+
+UINT32
+sysTimestampFreq(void)
+{
+	return 1000000;
+}
+
+UINT32
+sysTimestampPeriod(void)
+{
+	return 0xffffffff;
+}
+
+/* absolute CLOCK_MONOTONIC time ticks from now */
+LOCAL void
+vxShimDue(struct timespec *ts, int ticks)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+
+	ts->tv_sec += ticks / VXSHIM_CLK_RATE;
+	ts->tv_nsec += (long) (ticks % VXSHIM_CLK_RATE) *
+		(1000000000 / VXSHIM_CLK_RATE);
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Semaphores.
+// ---------------------------------------------------------------
+*/
+
+LOCAL SEM_ID
+vxShimSemCreate(int kind, int count)
+{
+	pthread_condattr_t ca;
+	SEM_ID sem;
+
+	if ((sem = (SEM_ID) calloc(1, sizeof (*sem))) == NULL)
+		return NULL;
+
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_mutex_init(&sem->m, NULL);
+	pthread_cond_init(&sem->c, &ca);
+	pthread_condattr_destroy(&ca);
+
+	sem->Kind = kind;
+	sem->Count = count;
+
+	return sem;
+}
+
+SEM_ID
+semBCreate(int options, int initial)
+{
+	(void) options;
+	return vxShimSemCreate(VXSHIM_SEM_BINARY, initial ? 1 : 0);
+}
+
+SEM_ID
+semCCreate(int options, int initial)
+{
+	(void) options;
+	return vxShimSemCreate(VXSHIM_SEM_COUNTING, initial);
+}
+
+SEM_ID
+semMCreate(int options)
+{
+	(void) options;
+	return vxShimSemCreate(VXSHIM_SEM_MUTEX, 0);
+}
+
+STATUS
+semDelete(SEM_ID sem)
+{
+	if (sem == NULL)
+		return ERROR;
+
+	pthread_cond_destroy(&sem->c);
+	pthread_mutex_destroy(&sem->m);
+	free(sem);
+
+	return OK;
+}
+
+STATUS
+semTake(SEM_ID sem, int timeout)
+{
+	struct timespec due;
+	unsigned int flushes;
+	int ret = 0;
+
+	if (vxShimSpin)
+		VXSHIM_FATAL("semTake() under a spinlock");
+
+	if (timeout > 0)
+		vxShimDue(&due, timeout);
+
+	pthread_mutex_lock(&sem->m);
+
+	if (sem->Kind == VXSHIM_SEM_MUTEX) {
+
+		if (sem->Depth && pthread_equal(sem->Owner, pthread_self())) {
+			sem->Depth++;
+			pthread_mutex_unlock(&sem->m);
+			return OK;
+		}
+
+		while (sem->Depth && (ret == 0) && (timeout != NO_WAIT))
+			ret = (timeout == WAIT_FOREVER) ?
+				pthread_cond_wait(&sem->c, &sem->m) :
+				pthread_cond_timedwait(&sem->c, &sem->m, &due);
+
+		if (sem->Depth == 0) {
+			sem->Owner = pthread_self();
+			sem->Depth = 1;
+			pthread_mutex_unlock(&sem->m);
+			return OK;
+		}
+
+	} else {
+
+		flushes = sem->Flushes;
+
+		while ((sem->Count == 0) && (sem->Flushes == flushes) &&
+			(ret == 0) && (timeout != NO_WAIT))
+			ret = (timeout == WAIT_FOREVER) ?
+				pthread_cond_wait(&sem->c, &sem->m) :
+				pthread_cond_timedwait(&sem->c, &sem->m, &due);
+
+		if (sem->Count > 0) {
+			sem->Count--;
+			pthread_mutex_unlock(&sem->m);
+			return OK;
+		}
+
+		if (sem->Flushes != flushes) {
+			pthread_mutex_unlock(&sem->m);
+			return OK;
+		}
+	}
+
+	pthread_mutex_unlock(&sem->m);
+
+	errno = (timeout == NO_WAIT) ?
+		S_objLib_OBJ_UNAVAILABLE : S_objLib_OBJ_TIMEOUT;
+
+	return ERROR;
+}
+
+STATUS
+semGive(SEM_ID sem)
+{
+	STATUS ret = OK;
+
+	if (vxShimSpin)
+		VXSHIM_FATAL("semGive() under a spinlock");
+
+	pthread_mutex_lock(&sem->m);
+
+	switch (sem->Kind) {
+
+	case VXSHIM_SEM_BINARY:
+		sem->Count = 1;
+		break;
+
+	case VXSHIM_SEM_COUNTING:
+		sem->Count++;
+		break;
+
+	default:
+		if ((sem->Depth == 0) ||
+			!pthread_equal(sem->Owner, pthread_self()))
+			ret = ERROR;
+		else
+			sem->Depth--;
+		break;
+	}
+
+	pthread_cond_broadcast(&sem->c);
+	pthread_mutex_unlock(&sem->m);
+
+	return ret;
+}
+
+STATUS
+semFlush(SEM_ID sem)
+{
+	if (vxShimSpin)
+		VXSHIM_FATAL("semFlush() under a spinlock");
+
+	pthread_mutex_lock(&sem->m);
+	sem->Flushes++;
+	pthread_cond_broadcast(&sem->c);
+	pthread_mutex_unlock(&sem->m);
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Tasks.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void *
+vxShimTaskMain(void *arg)
+{
+	VXSHIM_TASK *t = (VXSHIM_TASK *) arg;
+
+	vxShimTid = (int) (t - vxShimTask) + 1;
+
+	(*t->Entry)(t->Arg[0], t->Arg[1], t->Arg[2], t->Arg[3], t->Arg[4],
+		t->Arg[5], t->Arg[6], t->Arg[7], t->Arg[8], t->Arg[9]);
+
+	t->Alive = FALSE;
+
+	return NULL;
+}
+
+int
+taskSpawn(char *name, int priority, int options, int stackSize,
+	FUNCPTR entry, _Vx_usr_arg_t a1, _Vx_usr_arg_t a2, _Vx_usr_arg_t a3,
+	_Vx_usr_arg_t a4, _Vx_usr_arg_t a5, _Vx_usr_arg_t a6, _Vx_usr_arg_t a7,
+	_Vx_usr_arg_t a8, _Vx_usr_arg_t a9, _Vx_usr_arg_t a10)
+{
+	int i;
+	pthread_t thr;
+	pthread_attr_t pa;
+	VXSHIM_TASK *t = NULL;
+
+	(void) name;
+	(void) priority;
+	(void) options;
+	(void) stackSize;
+
+	pthread_mutex_lock(&vxShimTaskLock);
+
+	for (i = 0; i < VXSHIM_MAX_TASKS; ++i)
+		if (!vxShimTask[i].Used) {
+			t = vxShimTask + i;
+			t->Used = TRUE;
+			break;
+		}
+
+	pthread_mutex_unlock(&vxShimTaskLock);
+
+	if (t == NULL)
+		return ERROR;
+
+	t->Entry = entry;
+	t->Arg[0] = a1;
+	t->Arg[1] = a2;
+	t->Arg[2] = a3;
+	t->Arg[3] = a4;
+	t->Arg[4] = a5;
+	t->Arg[5] = a6;
+	t->Arg[6] = a7;
+	t->Arg[7] = a8;
+	t->Arg[8] = a9;
+	t->Arg[9] = a10;
+	t->Alive = TRUE;
+
+	pthread_attr_init(&pa);
+	pthread_attr_setdetachstate(&pa, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thr, &pa, vxShimTaskMain, t) != 0) {
+		t->Alive = FALSE;
+		pthread_attr_destroy(&pa);
+		return ERROR;
+	}
+
+	pthread_attr_destroy(&pa);
+
+	return i + 1;
+}
+
+STATUS
+taskDelay(int ticks)
+{
+	struct timespec ts;
+
+	if (ticks <= 0) {
+		sched_yield();
+		return OK;
+	}
+
+	ts.tv_sec = ticks / VXSHIM_CLK_RATE;
+	ts.tv_nsec = (long) (ticks % VXSHIM_CLK_RATE) *
+		(1000000000 / VXSHIM_CLK_RATE);
+
+	while (nanosleep(&ts, &ts) != 0)
+		;
+
+	return OK;
+}
+
+/* threads not started by taskSpawn() get an id of their own */
+int
+taskIdSelf(void)
+{
+	int i;
+
+	if (vxShimTid)
+		return vxShimTid;
+
+	pthread_mutex_lock(&vxShimTaskLock);
+
+	for (i = 0; i < VXSHIM_MAX_TASKS; ++i)
+		if (!vxShimTask[i].Used) {
+			vxShimTask[i].Used = TRUE;
+			vxShimTask[i].Alive = TRUE;
+			vxShimTid = i + 1;
+			break;
+		}
+
+	pthread_mutex_unlock(&vxShimTaskLock);
+
+	return vxShimTid;
+}
+
+STATUS
+taskIdVerify(int tid)
+{
+	if ((tid < 1) || (tid > VXSHIM_MAX_TASKS) || !vxShimTask[tid - 1].Alive)
+		return ERROR;
+
+	return OK;
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Watchdogs.
+// ---------------------------------------------------------------
+*/
+
+LOCAL void *
+vxShimWdMain(void *arg)
+{
+	WDOG_ID wd = (WDOG_ID) arg;
+	struct timespec ts;
+	unsigned int gen;
+	ULONG now;
+	FUNCPTR fn;
+	_Vx_usr_arg_t a;
+
+	vxShimInt = TRUE;
+
+	pthread_mutex_lock(&wd->m);
+
+	for (;;) {
+
+		while (!wd->Armed)
+			pthread_cond_wait(&wd->c, &wd->m);
+
+		now = tickGet();
+
+		if ((long) (wd->Due - now) > 0) {
+			gen = wd->Gen;
+			vxShimDue(&ts, (int) (wd->Due - now));
+			while ((wd->Gen == gen) &&
+				(pthread_cond_timedwait(&wd->c, &wd->m, &ts) == 0))
+				;
+			continue;
+		}
+
+		wd->Armed = FALSE;
+		fn = wd->Fn;
+		a = wd->Arg;
+
+		pthread_mutex_unlock(&wd->m);
+		(*fn)(a);
+		pthread_mutex_lock(&wd->m);
+	}
+
+	return NULL;
+}
+
+WDOG_ID
+wdCreate(void)
+{
+	pthread_condattr_t ca;
+	WDOG_ID wd;
+
+	if ((wd = (WDOG_ID) calloc(1, sizeof (*wd))) == NULL)
+		return NULL;
+
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_mutex_init(&wd->m, NULL);
+	pthread_cond_init(&wd->c, &ca);
+	pthread_condattr_destroy(&ca);
+
+	if (pthread_create(&wd->Thread, NULL, vxShimWdMain, wd) != 0) {
+		free(wd);
+		return NULL;
+	}
+
+	pthread_detach(wd->Thread);
+
+	return wd;
+}
+
+STATUS
+wdStart(WDOG_ID wd, int delay, FUNCPTR fn, _Vx_usr_arg_t arg)
+{
+	pthread_mutex_lock(&wd->m);
+
+	wd->Due = tickGet() + (ULONG) ((delay > 0) ? delay : 1);
+	wd->Fn = fn;
+	wd->Arg = arg;
+	wd->Armed = TRUE;
+	wd->Gen++;
+
+	pthread_cond_broadcast(&wd->c);
+	pthread_mutex_unlock(&wd->m);
+
+	return OK;
+}
+
+STATUS
+wdCancel(WDOG_ID wd)
+{
+	pthread_mutex_lock(&wd->m);
+
+	wd->Armed = FALSE;
+	wd->Gen++;
+
+	pthread_cond_broadcast(&wd->c);
+	pthread_mutex_unlock(&wd->m);
+
+	return OK;
+}
+
+/* the thread keeps running; the host program exits soon enough */
+STATUS
+wdDelete(WDOG_ID wd)
+{
+	return wdCancel(wd);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Interrupt locks and spinlocks.
+// ---------------------------------------------------------------
+*/
+
+int
+intContext(void)
+{
+	return vxShimInt;
+}
+
+int
+intLock(void)
+{
+	pthread_mutex_lock(&vxShimIntLock);
+	return 0;
+}
+
+void
+intUnlock(int level)
+{
+	(void) level;
+	pthread_mutex_unlock(&vxShimIntLock);
+}
+
+void
+spinLockIsrInit(spinlockIsr_t *lock, int flags)
+{
+	pthread_mutexattr_t ma;
+
+	(void) flags;
+
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_ERRORCHECK);
+	pthread_mutex_init(&lock->m, &ma);
+	pthread_mutexattr_destroy(&ma);
+}
+
+void
+spinLockIsrTake(spinlockIsr_t *lock)
+{
+	if (pthread_mutex_lock(&lock->m) != 0)
+		VXSHIM_FATAL("spinlock taken twice");
+
+	vxShimSpin++;
+}
+
+void
+spinLockIsrGive(spinlockIsr_t *lock)
+{
+	vxShimSpin--;
+
+	if (pthread_mutex_unlock(&lock->m) != 0)
+		VXSHIM_FATAL("spinlock given by a thread not holding it");
+}
+
+atomicVal_t
+vxAtomicSet(atomic_t *target, atomicVal_t value)
+{
+	return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+BOOL
+vxAtomicCas(atomic_t *target, atomicVal_t oldValue, atomicVal_t newValue)
+{
+	return __atomic_compare_exchange_n(target, &oldValue, newValue, FALSE,
+		__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+
+/*
+// ---------------------------------------------------------------
+// Errors and logging.
+// ---------------------------------------------------------------
+*/
+
+int
+errnoGet(void)
+{
+	return errno;
+}
+
+STATUS
+errnoSet(int error)
+{
+	errno = error;
+	return OK;
+}
+
+int
+logMsg(char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	return n;
+}